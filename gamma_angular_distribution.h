@@ -0,0 +1,213 @@
+/**
+ *  gamma_angular_distribution.h
+ *
+ *  Angle integration of yields measured by detectors at several
+ *  angles. In every TOF (or neutron-energy) bin the differential
+ *  yields y_d of the detectors at angles theta_d are fitted with
+ *
+ *    W(theta) = sum_k a_k P_k(cos theta)
+ *
+ *  by weighted least squares (weights 1 / sigma_d^2). The angle-
+ *  integrated yield is 4 pi a_0, since only P_0 survives the
+ *  integration over the full solid angle.
+ *
+ *  The inputs must be per unit solid angle and efficiency, e.g. the
+ *  dsigma/dOmega of normalize_yields() with each detector's intrinsic
+ *  efficiency and solid angle. Usually only even orders are fitted
+ *  (gamma rays from aligned nuclei, no parity mixing).
+ *
+ *  The design matrix is the same for all bins, only the weights
+ *  differ, so the normal equations of all bins are accumulated in
+ *  structure-of-arrays form: one contiguous, vectorizable loop over
+ *  bins per (detector, matrix element).
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// Legendre polynomials
+// ------------------------------------------------------------
+
+/**
+ * P_l(x) by the Bonnet recursion.
+ */
+inline double legendre(int l, double x)
+{
+    if (l == 0)
+        return 1.0;
+    double p0 = 1.0, p1 = x;
+    for (int k = 2; k <= l; ++k) {
+        const double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+        p0 = p1;
+        p1 = p2;
+    }
+    return p1;
+}
+
+// ------------------------------------------------------------
+// Batched fit
+// ------------------------------------------------------------
+
+struct AngularFitConfig {
+    int  max_order = 4;         // highest Legendre order
+    bool even_only = true;      // fit a_0, a_2, a_4, ...
+    unsigned n_threads = 0;
+};
+
+constexpr int max_angular_parameters = 4;
+
+struct AngularFitResult {
+    bool valid = false;                         // config and inputs accepted
+    std::vector<int> orders;                    // fitted Legendre orders
+
+    // coefficient[p][i]: a_{orders[p]} in bin i
+    std::vector<std::vector<double>> coefficient;
+
+    // covariance[p * n_par + q][i]: cov(a_p, a_q) in bin i
+    std::vector<std::vector<double>> covariance;
+
+    YieldResult integrated;                     // 4 pi a_0
+    std::vector<double> chi2;                   // per bin
+    std::vector<int>    ndf;                    // detectors used - n_par
+    std::vector<char>   ok;                     // fit defined in bin
+
+    int n_par() const { return static_cast<int>(orders.size()); }
+};
+
+/**
+ * Fit all bins at once. detectors[d] holds the differential yields
+ * (binned alike) of the detector at angle_deg[d]. Detector bins with
+ * zero error carry no weight; bins with fewer weighted detectors than
+ * parameters are flagged !ok and left at zero.
+ *
+ * At most max_angular_parameters orders are supported (e.g. 0-6
+ * even, or 0-3). A config asking for more, or for none, and inputs
+ * with angle_deg.size() != detectors.size() or unequal binning are
+ * rejected: the result is returned empty with valid = false.
+ */
+inline AngularFitResult fit_angular_distribution(
+    const std::vector<YieldResult>& detectors,
+    const std::vector<double>& angle_deg,
+    const AngularFitConfig& cfg = AngularFitConfig{}
+)
+{
+    AngularFitResult result;
+    for (int l = 0; l <= cfg.max_order; l += cfg.even_only ? 2 : 1)
+        result.orders.push_back(l);
+
+    const int np = result.n_par();
+    const size_t n_det = detectors.size();
+    const size_t n = n_det ? detectors.front().yield.size() : 0;
+
+    bool inputs_ok = np >= 1 && np <= max_angular_parameters &&
+                     angle_deg.size() == n_det;
+    for (const auto& det : detectors)
+        inputs_ok = inputs_ok && det.yield.size() == n && det.error.size() == n;
+    if (!inputs_ok)
+        return AngularFitResult{};
+    result.valid = true;
+
+    result.coefficient.assign(np, std::vector<double>(n, 0.0));
+    result.covariance.assign(np * np, std::vector<double>(n, 0.0));
+    result.integrated.yield.assign(n, 0.0);
+    result.integrated.error.assign(n, 0.0);
+    result.chi2.assign(n, 0.0);
+    result.ndf.assign(n, 0);
+    result.ok.assign(n, 0);
+
+    const double pi = std::acos(-1.0);
+
+    // P_l(cos theta_d) for every detector and fitted order
+    std::vector<double> P(n_det * np);
+    for (size_t d = 0; d < n_det; ++d) {
+        const double c = std::cos(angle_deg[d] * pi / 180.0);
+        for (int p = 0; p < np; ++p)
+            P[d * np + p] = legendre(result.orders[p], c);
+    }
+
+    constexpr size_t chunk = 1024;      // bins per work item
+    const size_t n_chunks = (n + chunk - 1) / chunk;
+
+    parallel_for(n_chunks, [&](size_t c) {
+        const size_t i0 = c * chunk;
+        const size_t m  = std::min(chunk, n - i0);
+
+        // Normal equations of all bins in the chunk (SoA)
+        std::vector<double> N(np * np * m, 0.0), b(np * m, 0.0),
+                            w(m), n_used(m, 0.0);
+
+        for (size_t d = 0; d < n_det; ++d) {
+            const double* y  = detectors[d].yield.data() + i0;
+            const double* dy = detectors[d].error.data() + i0;
+            for (size_t i = 0; i < m; ++i) {
+                w[i] = dy[i] > 0.0 ? 1.0 / (dy[i] * dy[i]) : 0.0;
+                n_used[i] += dy[i] > 0.0 ? 1.0 : 0.0;
+            }
+
+            for (int p = 0; p < np; ++p) {
+                const double Pp = P[d * np + p];
+                double* bp = &b[p * m];
+                for (size_t i = 0; i < m; ++i)
+                    bp[i] += w[i] * Pp * y[i];
+
+                for (int q = p; q < np; ++q) {
+                    const double PpPq = Pp * P[d * np + q];
+                    double* Npq = &N[(p * np + q) * m];
+                    for (size_t i = 0; i < m; ++i)
+                        Npq[i] += w[i] * PpPq;
+                }
+            }
+        }
+
+        // Per-bin inversion and solution
+        for (size_t i = 0; i < m; ++i) {
+            const size_t bin = i0 + i;
+            if (n_used[i] < np)
+                continue;
+
+            double A[max_angular_parameters * max_angular_parameters];
+            for (int p = 0; p < np; ++p)
+                for (int q = p; q < np; ++q)
+                    A[p * np + q] = A[q * np + p] = N[(p * np + q) * m + i];
+            if (!invert_small(np, A))
+                continue;
+
+            double a[max_angular_parameters] = {};
+            for (int p = 0; p < np; ++p) {
+                for (int q = 0; q < np; ++q)
+                    a[p] += A[p * np + q] * b[q * m + i];
+                result.coefficient[p][bin] = a[p];
+            }
+            for (int k = 0; k < np * np; ++k)
+                result.covariance[k][bin] = A[k];
+
+            double chi2 = 0.0;
+            for (size_t d = 0; d < n_det; ++d) {
+                const double dy = detectors[d].error[bin];
+                if (dy <= 0.0)
+                    continue;
+                double fit = 0.0;
+                for (int p = 0; p < np; ++p)
+                    fit += a[p] * P[d * np + p];
+                const double r = (detectors[d].yield[bin] - fit) / dy;
+                chi2 += r * r;
+            }
+
+            result.chi2[bin] = chi2;
+            result.ndf[bin]  = static_cast<int>(n_used[i]) - np;
+            result.ok[bin]   = 1;
+            result.integrated.yield[bin] = 4.0 * pi * a[0];
+            result.integrated.error[bin] = 4.0 * pi * std::sqrt(A[0]);
+        }
+    }, cfg.n_threads);
+
+    return result;
+}
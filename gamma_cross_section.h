@@ -0,0 +1,219 @@
+/**
+ *  gamma_cross_section.h
+ *
+ *  Normalization of net gamma-ray yields to gamma-production
+ *  cross sections:
+ *
+ *    sigma_i = Y_i / (Phi_i * n_t * eps(E_gamma) * L_i [* dOmega])
+ *
+ *  with Y_i the net yield and Phi_i the neutron flux in bin i (TOF
+ *  or neutron energy, same binning), n_t the target areal density,
+ *  eps the full-energy-peak efficiency at the line energy and L_i
+ *  the live-time fraction. With an absolute efficiency the result
+ *  is the angle-integrated cross section (isotropy assumed); with an
+ *  intrinsic efficiency and the detector solid angle dOmega it is
+ *  dsigma/dOmega at the detector angle.
+ *
+ *  Uncertainties are split into a per-bin part (yield, flux, live
+ *  time) and a per-line scale part (efficiency, areal density) that
+ *  is fully correlated between bins.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// Efficiency curve
+// ------------------------------------------------------------
+
+/**
+ * Tabulated full-energy-peak efficiency, interpolated linearly in
+ * log(E)-log(eps); constant extrapolation outside the table.
+ */
+struct EfficiencyCurve {
+    std::vector<double> energy_keV;     // increasing
+    std::vector<double> efficiency;
+    std::vector<double> error;          // absolute
+
+    void evaluate(double e_keV, double& eff, double& err) const
+    {
+        const size_t n = energy_keV.size();
+        if (n == 0) {
+            eff = 1.0;
+            err = 0.0;
+            return;
+        }
+        if (e_keV <= energy_keV.front() || n == 1) {
+            eff = efficiency.front();
+            err = error.front();
+            return;
+        }
+        if (e_keV >= energy_keV.back()) {
+            eff = efficiency.back();
+            err = error.back();
+            return;
+        }
+
+        const size_t i = std::upper_bound(energy_keV.begin(),
+                                          energy_keV.end(), e_keV)
+                         - energy_keV.begin() - 1;
+        const double f = std::log(e_keV / energy_keV[i])
+                       / std::log(energy_keV[i + 1] / energy_keV[i]);
+
+        eff = std::exp((1.0 - f) * std::log(efficiency[i])
+                       + f * std::log(efficiency[i + 1]));
+        err = eff * ((1.0 - f) * error[i] / efficiency[i]
+                     + f * error[i + 1] / efficiency[i + 1]);
+    }
+};
+
+/**
+ * Read "E_keV efficiency error" lines ('#' starts a comment).
+ */
+inline bool read_efficiency_curve(const std::string& path,
+                                  EfficiencyCurve& curve)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::vector<std::array<double, 3>> points;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line.substr(0, line.find('#')));
+        double e, eff, err = 0.0;
+        if (ss >> e >> eff) {
+            ss >> err;
+            points.push_back({e, eff, err});
+        }
+    }
+    std::sort(points.begin(), points.end());
+
+    curve = EfficiencyCurve{};
+    for (const auto& p : points) {
+        curve.energy_keV.push_back(p[0]);
+        curve.efficiency.push_back(p[1]);
+        curve.error.push_back(p[2]);
+    }
+    return !points.empty();
+}
+
+// ------------------------------------------------------------
+// Normalization
+// ------------------------------------------------------------
+
+struct NormalizationInputs {
+    // Neutrons per bin (yield = flux, error = its uncertainty), binned
+    // like the yields; energy-binned flux can be produced with
+    // rebin_yield_to_energy.
+    YieldResult flux;
+
+    // Live-time fraction per bin and its uncertainty; empty = 1
+    std::vector<double> live_fraction;
+    std::vector<double> live_fraction_error;
+
+    double areal_density           = 1.0;   // atoms / barn
+    double areal_density_rel_error = 0.0;
+    double solid_angle_sr          = 0.0;   // 0: absolute efficiency
+};
+
+struct CrossSectionResult {
+    std::vector<double> value;          // barn (or barn / sr)
+    std::vector<double> stat_error;     // per-bin, uncorrelated
+    double scale_rel_error = 0.0;       // common to all bins of the line
+};
+
+/**
+ * Normalize the yields of several gamma lines at once. All
+ * per-bin factors are combined into one array first, so each line
+ * costs a single branch-free (vectorizable) pass over the bins.
+ *
+ * Throws std::invalid_argument unless every line, the flux errors
+ * and the (non-empty) live-time arrays have the flux's bin count,
+ * and there is one line energy per line.
+ */
+inline std::vector<CrossSectionResult> normalize_yields(
+    const std::vector<YieldResult>& lines,
+    const std::vector<double>& line_energy_keV,
+    const EfficiencyCurve& efficiency,
+    const NormalizationInputs& in)
+{
+    const size_t n = in.flux.yield.size();
+    const bool has_live = !in.live_fraction.empty();
+
+    auto require = [](bool condition, const std::string& what) {
+        if (!condition)
+            throw std::invalid_argument("normalize_yields: " + what);
+    };
+    require(in.flux.error.size() == n, "flux error size differs from flux");
+    require(!has_live || in.live_fraction.size() == n,
+            "live_fraction size differs from flux");
+    require(in.live_fraction_error.empty() ||
+            (has_live && in.live_fraction_error.size() == n),
+            "live_fraction_error size differs from live_fraction");
+    require(line_energy_keV.size() == lines.size(),
+            "one line energy per line required");
+    for (size_t l = 0; l < lines.size(); ++l)
+        require(lines[l].yield.size() == n && lines[l].error.size() == n,
+                "line " + std::to_string(l) + " size differs from flux");
+    const double geometry =
+        in.areal_density * (in.solid_angle_sr > 0.0 ? in.solid_angle_sr : 1.0);
+
+    // Bin-dependent 1 / (Phi_i * L_i * n_t [* dOmega]) and the squared
+    // relative error of Phi_i * L_i; bins without flux give zero
+    std::vector<double> inv_denom(n, 0.0), denom_rel2(n, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        const double phi  = in.flux.yield[i];
+        const double live = has_live ? in.live_fraction[i] : 1.0;
+        if (phi <= 0.0 || live <= 0.0)
+            continue;
+
+        const double rphi = in.flux.error[i] / phi;
+        const double rliv = has_live && !in.live_fraction_error.empty()
+                          ? in.live_fraction_error[i] / live : 0.0;
+        inv_denom[i]  = 1.0 / (phi * live * geometry);
+        denom_rel2[i] = rphi * rphi + rliv * rliv;
+    }
+
+    std::vector<CrossSectionResult> results(lines.size());
+
+    for (size_t l = 0; l < lines.size(); ++l) {
+        double eff, eff_err;
+        efficiency.evaluate(line_energy_keV[l], eff, eff_err);
+
+        const double inv_eff = 1.0 / eff;
+        const double* y  = lines[l].yield.data();
+        const double* dy = lines[l].error.data();
+
+        CrossSectionResult& r = results[l];
+        r.value.resize(n);
+        r.stat_error.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            const double scale = inv_eff * inv_denom[i];
+            const double xs = y[i] * scale;
+            r.value[i] = xs;
+            r.stat_error[i] =
+                std::sqrt(dy[i] * dy[i] * scale * scale
+                          + xs * xs * denom_rel2[i]);
+        }
+
+        r.scale_rel_error = std::sqrt(
+            std::pow(eff_err / eff, 2) +
+            std::pow(in.areal_density_rel_error, 2));
+    }
+
+    return results;
+}
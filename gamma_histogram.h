@@ -0,0 +1,428 @@
+/**
+ *  gamma_histogram.h
+ *
+ *  Lightweight TOF-energy histogram for ROOT-free yield extraction:
+ *  one contiguous row of energy bins per TOF bin (row-major), so
+ *  window sums walk memory linearly. Uniform axes; energy under- and
+ *  overflow bins are kept so bin numbering matches TH2F.
+ *
+ *  Two on-disk formats are supported:
+ *   - a small native binary format (.gyh), written from ROOT with
+ *     write_histogram2d() and read back without ROOT
+ *   - NumPy .npy 2D arrays (C order, shape n_tof x n_energy,
+ *     float32/float64 or integer), e.g. from np.save()
+ *
+ *  Histogram3D stacks the matrices of several detectors with common
+ *  axes, so all of them are extracted in a single parallel pass.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// Container
+// ------------------------------------------------------------
+
+struct Histogram2D {
+    int n_tof    = 0;
+    int n_energy = 0;
+    double tof_min = 0.0, tof_max = 1.0;         // ns
+    double energy_min = 0.0, energy_max = 1.0;
+
+    // n_tof rows of n_energy + 2 bins (energy bin 0 = underflow)
+    std::vector<double> contents;
+
+    int row_size() const { return n_energy + 2; }
+
+    // ib: TOF bin (1-based), ie: energy bin (ROOT numbering)
+    double& at(int ib, int ie)
+    {
+        return contents[size_t(ib - 1) * row_size() + ie];
+    }
+    double at(int ib, int ie) const
+    {
+        return contents[size_t(ib - 1) * row_size() + ie];
+    }
+
+    const double* row(int ib) const
+    {
+        return &contents[size_t(ib - 1) * row_size()];
+    }
+
+    void resize(int tof_bins, int energy_bins)
+    {
+        n_tof    = tof_bins;
+        n_energy = energy_bins;
+        contents.assign(size_t(n_tof) * row_size(), 0.0);
+    }
+
+    std::vector<double> tof_edges() const
+    {
+        std::vector<double> edges(n_tof + 1);
+        for (int i = 0; i <= n_tof; ++i)
+            edges[i] = tof_min + (tof_max - tof_min) * i / n_tof;
+        return edges;
+    }
+};
+
+/**
+ * Cumulative energy sums of a Histogram2D (see WindowSumTable).
+ */
+inline WindowSumTable build_window_sum_table(const Histogram2D& h)
+{
+    WindowSumTable table;
+    table.n_tof    = h.n_tof;
+    table.n_energy = h.n_energy;
+
+    const size_t row_size = table.n_energy + 3;
+    table.cumsum.resize(row_size * table.n_tof, 0.0);
+
+    for (int ib = 1; ib <= h.n_tof; ++ib) {
+        const double* in = h.row(ib);
+        double* out = &table.cumsum[(ib - 1) * row_size];
+        double sum = 0.0;
+        for (int ie = 0; ie <= h.n_energy + 1; ++ie) {
+            sum += in[ie];
+            out[ie + 1] = sum;
+        }
+    }
+
+    return table;
+}
+
+// ------------------------------------------------------------
+// Native binary format
+// ------------------------------------------------------------
+
+//  char    magic[8]  "GYHIST01"
+//  int32   n_tof, n_energy
+//  double  tof_min, tof_max, energy_min, energy_max
+//  double  contents[n_tof * (n_energy + 2)]    (host byte order)
+constexpr char histogram2d_magic[8] = {'G', 'Y', 'H', 'I', 'S', 'T', '0', '1'};
+
+inline bool write_histogram2d(const std::string& path, const Histogram2D& h)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+
+    const int32_t dims[2] = {h.n_tof, h.n_energy};
+    const double axes[4] = {h.tof_min, h.tof_max, h.energy_min, h.energy_max};
+
+    out.write(histogram2d_magic, sizeof(histogram2d_magic));
+    out.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    out.write(reinterpret_cast<const char*>(axes), sizeof(axes));
+    out.write(reinterpret_cast<const char*>(h.contents.data()),
+              h.contents.size() * sizeof(double));
+    return bool(out);
+}
+
+inline bool read_histogram2d(const std::string& path, Histogram2D& h)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[8];
+    int32_t dims[2];
+    double axes[4];
+
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, histogram2d_magic, sizeof(magic)) != 0)
+        return false;
+    if (!in.read(reinterpret_cast<char*>(dims), sizeof(dims)) ||
+        !in.read(reinterpret_cast<char*>(axes), sizeof(axes)))
+        return false;
+    if (dims[0] <= 0 || dims[1] <= 0)
+        return false;
+
+    h.resize(dims[0], dims[1]);
+    h.tof_min    = axes[0];
+    h.tof_max    = axes[1];
+    h.energy_min = axes[2];
+    h.energy_max = axes[3];
+
+    return bool(in.read(reinterpret_cast<char*>(h.contents.data()),
+                        h.contents.size() * sizeof(double)));
+}
+
+// ------------------------------------------------------------
+// NumPy .npy
+// ------------------------------------------------------------
+
+template <typename T>
+inline void copy_npy_rows(std::ifstream& in, Histogram2D& h)
+{
+    std::vector<T> buffer(h.n_energy);
+    for (int ib = 1; ib <= h.n_tof && in; ++ib) {
+        in.read(reinterpret_cast<char*>(buffer.data()),
+                buffer.size() * sizeof(T));
+        for (int k = 0; k < h.n_energy; ++k)
+            h.at(ib, k + 1) = static_cast<double>(buffer[k]);
+    }
+}
+
+/**
+ * Read a 2D little-endian .npy array (format versions 1-3) into h.
+ * Arrays of any other rank, and files whose data size does not
+ * match the shape, are rejected. The axes are left in bin units
+ * unless set by the caller.
+ */
+inline bool read_npy_histogram(const std::string& path, Histogram2D& h)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[6];
+    uint8_t version[2];
+    if (!in.read(magic, 6) || std::memcmp(magic, "\x93NUMPY", 6) != 0 ||
+        !in.read(reinterpret_cast<char*>(version), 2))
+        return false;
+
+    uint32_t header_len = 0;
+    if (version[0] == 1) {
+        uint16_t len16;
+        in.read(reinterpret_cast<char*>(&len16), 2);
+        header_len = len16;
+    } else {
+        in.read(reinterpret_cast<char*>(&header_len), 4);
+    }
+    if (!in)
+        return false;
+
+    std::string header(header_len, '\0');
+    if (!in.read(&header[0], header_len))
+        return false;
+
+    auto value_of = [&](const std::string& key) {
+        const size_t k = header.find("'" + key + "'");
+        if (k == std::string::npos)
+            return std::string();
+        const size_t colon = header.find(':', k);
+        return header.substr(colon + 1);
+    };
+
+    // Missing keys are treated as malformed input
+    const std::string order = value_of("fortran_order");
+    const size_t order_pos = order.find_first_not_of(' ');
+    if (order_pos == std::string::npos ||
+        order.compare(order_pos, 5, "False") != 0)
+        return false;
+
+    const std::string descr_field = value_of("descr");
+    const size_t q0 = descr_field.find('\'');
+    const size_t q1 = q0 == std::string::npos
+                    ? std::string::npos : descr_field.find('\'', q0 + 1);
+    if (q1 == std::string::npos)
+        return false;
+    const std::string descr = descr_field.substr(q0 + 1, q1 - q0 - 1);
+
+    size_t item_size = 0;
+    if      (descr == "<f8" || descr == "<i8" || descr == "<u8") item_size = 8;
+    else if (descr == "<f4" || descr == "<i4" || descr == "<u4") item_size = 4;
+    else if (descr == "<u2") item_size = 2;
+    else
+        return false;
+
+    // Shape tuple: exactly two positive dimensions
+    const std::string shape = value_of("shape");
+    const size_t open  = shape.find('(');
+    const size_t close = shape.find(')');
+    if (open == std::string::npos || close == std::string::npos || close < open)
+        return false;
+
+    std::vector<long> dims;
+    std::istringstream dims_in(shape.substr(open + 1, close - open - 1));
+    std::string item;
+    while (std::getline(dims_in, item, ',')) {
+        if (item.find_first_not_of(' ') == std::string::npos)
+            continue;   // trailing comma of a 1-tuple
+        char* end = nullptr;
+        const long dim = std::strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() ||
+            item.find_first_not_of(' ', end - item.c_str()) != std::string::npos)
+            return false;
+        dims.push_back(dim);
+    }
+    if (dims.size() != 2)
+        return false;
+
+    const long n0 = dims[0], n1 = dims[1];
+    const long max_dim = std::numeric_limits<int>::max() - 2;
+    if (n0 <= 0 || n1 <= 0 || n0 > max_dim || n1 > max_dim)
+        return false;
+
+    // The payload must hold exactly n0 x n1 items
+    const std::streampos data_start = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff payload = in.tellg() - data_start;
+    in.seekg(data_start);
+    if (!in || payload < 0 ||
+        uint64_t(payload) / item_size / uint64_t(n0) != uint64_t(n1) ||
+        uint64_t(payload) != uint64_t(n0) * uint64_t(n1) * item_size)
+        return false;
+
+    h.resize(static_cast<int>(n0), static_cast<int>(n1));
+    h.tof_min = 0.0;
+    h.tof_max = double(n0);
+    h.energy_min = 0.0;
+    h.energy_max = double(n1);
+
+    if      (descr == "<f8") copy_npy_rows<double>(in, h);
+    else if (descr == "<f4") copy_npy_rows<float>(in, h);
+    else if (descr == "<i8") copy_npy_rows<int64_t>(in, h);
+    else if (descr == "<i4") copy_npy_rows<int32_t>(in, h);
+    else if (descr == "<u8") copy_npy_rows<uint64_t>(in, h);
+    else if (descr == "<u4") copy_npy_rows<uint32_t>(in, h);
+    else if (descr == "<u2") copy_npy_rows<uint16_t>(in, h);
+    else
+        return false;
+
+    return bool(in);
+}
+
+// ------------------------------------------------------------
+// Multi-detector matrices
+// ------------------------------------------------------------
+
+/**
+ * (detector, TOF, energy) counts: one Histogram2D layout per
+ * detector, stacked detector-major. All detectors share the axes.
+ */
+struct Histogram3D {
+    int n_detectors = 0;
+    int n_tof       = 0;
+    int n_energy    = 0;
+    double tof_min = 0.0, tof_max = 1.0;         // ns
+    double energy_min = 0.0, energy_max = 1.0;
+
+    std::vector<double> contents;
+
+    int row_size() const { return n_energy + 2; }
+
+    // d: detector (0-based), ib: TOF bin (1-based)
+    const double* row(int d, int ib) const
+    {
+        return &contents[(size_t(d) * n_tof + (ib - 1)) * row_size()];
+    }
+    double* row(int d, int ib)
+    {
+        return &contents[(size_t(d) * n_tof + (ib - 1)) * row_size()];
+    }
+
+    void resize(int detectors, int tof_bins, int energy_bins)
+    {
+        n_detectors = detectors;
+        n_tof       = tof_bins;
+        n_energy    = energy_bins;
+        contents.assign(size_t(n_detectors) * n_tof * row_size(), 0.0);
+    }
+
+    std::vector<double> tof_edges() const
+    {
+        std::vector<double> edges(n_tof + 1);
+        for (int i = 0; i <= n_tof; ++i)
+            edges[i] = tof_min + (tof_max - tof_min) * i / n_tof;
+        return edges;
+    }
+};
+
+struct DetectorYields {
+    std::vector<YieldResult> detector;  // one per detector
+    YieldResult combined;               // sum, errors in quadrature
+};
+
+/**
+ * Side-band extraction of every detector in one parallel pass.
+ *
+ * Work items are (detector, TOF chunk); each builds the cumulative
+ * sums of its chunk only and extracts it right away, so no full
+ * window table is kept. windows holds one entry per detector, or a
+ * single entry used for all of them; any other count throws
+ * std::invalid_argument.
+ */
+inline DetectorYields extract_detector_yields(
+    const Histogram3D& h,
+    const std::vector<YieldWindows>& windows,
+    unsigned n_threads = 0
+)
+{
+    if (windows.size() != 1 &&
+        windows.size() != static_cast<size_t>(h.n_detectors))
+        throw std::invalid_argument(
+            "extract_detector_yields: " + std::to_string(windows.size())
+            + " windows for " + std::to_string(h.n_detectors)
+            + " detectors (need 1 or one per detector)");
+
+    constexpr int chunk = 256;   // TOF bins per work item
+
+    DetectorYields out;
+    out.detector.resize(h.n_detectors);
+    for (auto& r : out.detector) {
+        r.yield.resize(h.n_tof, 0.0);
+        r.error.resize(h.n_tof, 0.0);
+    }
+
+    const size_t n_chunks = (h.n_tof + chunk - 1) / chunk;
+    const size_t row_size = h.n_energy + 3;
+
+    parallel_for(h.n_detectors * n_chunks, [&](size_t task) {
+        const int d  = static_cast<int>(task / n_chunks);
+        const int ib0 = 1 + static_cast<int>(task % n_chunks) * chunk;
+        const int n  = std::min(chunk, h.n_tof - ib0 + 1);
+
+        WindowSumTable table;
+        table.n_tof    = n;
+        table.n_energy = h.n_energy;
+        table.cumsum.assign(row_size * n, 0.0);
+
+        for (int k = 0; k < n; ++k) {
+            const double* in = h.row(d, ib0 + k);
+            double* cum = &table.cumsum[k * row_size];
+            double sum = 0.0;
+            for (int ie = 0; ie <= h.n_energy + 1; ++ie) {
+                sum += in[ie];
+                cum[ie + 1] = sum;
+            }
+        }
+
+        YieldResult part;
+        part.yield.resize(n);
+        part.error.resize(n);
+        extract_yield_bins(table, windows[windows.size() == 1 ? 0 : d],
+                           1, n, part);
+
+        std::copy(part.yield.begin(), part.yield.end(),
+                  out.detector[d].yield.begin() + (ib0 - 1));
+        std::copy(part.error.begin(), part.error.end(),
+                  out.detector[d].error.begin() + (ib0 - 1));
+    }, n_threads);
+
+    out.combined.yield.assign(h.n_tof, 0.0);
+    out.combined.error.assign(h.n_tof, 0.0);
+    for (const auto& r : out.detector)
+        for (int i = 0; i < h.n_tof; ++i) {
+            out.combined.yield[i] += r.yield[i];
+            out.combined.error[i] += r.error[i] * r.error[i];
+        }
+    for (double& e : out.combined.error)
+        e = std::sqrt(e);
+
+    return out;
+}
@@ -0,0 +1,423 @@
+/**
+ *  gamma_peak_fit.h
+ *
+ *  Simultaneous fit of a gamma-ray peak in all TOF slices of the
+ *  TOF-energy matrix, as an alternative to side-band subtraction
+ *  when the background is curved or neighbouring lines overlap
+ *  the side-bands.
+ *
+ *  Model for slice j, energy bin k (centre x_k, width dx):
+ *    f_jk = A_j * dx * Gauss(x_k; mu, sigma) + sum_p b_jp * t_k^p
+ *  with t_k = energy scaled to [-1, 1] over the fit range.
+ *  Peak position mu and width sigma are shared by all slices;
+ *  area A_j and polynomial background b_j are per slice.
+ *
+ *  The fit maximizes the Poisson likelihood. For fixed (mu, sigma)
+ *  each slice is a small Newton problem in its linear parameters
+ *  (analytic gradient and Hessian), warm-started from the
+ *  neighbouring TOF slice or the previous iteration. The shared
+ *  parameters are updated by a damped Gauss-Newton step on the
+ *  profile likelihood. Slices are processed in parallel.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// Configuration and result
+// ------------------------------------------------------------
+
+struct PeakFitConfig {
+    double mu_start;            // initial peak position (energy units)
+    double sigma_start;         // initial peak width (energy units)
+    int    poly_order  = 1;     // background polynomial order, 0..2
+    int    max_iter    = 50;    // shared-parameter iterations
+    double tolerance   = 1e-6;  // convergence, relative to sigma
+    unsigned n_threads = 0;
+};
+
+struct PeakFitResult {
+    double mu = 0.0, mu_error = 0.0;
+    double sigma = 0.0, sigma_error = 0.0;
+
+    YieldResult area;                            // A_j and its error per slice
+    std::vector<std::array<double, 3>> background;
+    std::vector<double> deviance;                // Poisson deviance per slice
+    int    n_bins_fit = 0;                       // energy bins per slice
+
+    int  iterations = 0;
+    bool converged  = false;
+};
+
+constexpr double sqrt_two_pi = 2.5066282746310002;
+
+// ------------------------------------------------------------
+// Per-slice fit
+// ------------------------------------------------------------
+
+/**
+ * Linear parameters of one slice: theta = {A, b0, b1, b2}.
+ */
+struct SliceState {
+    std::array<double, 4> theta{};
+    bool initialized = false;
+};
+
+/**
+ * Contributions of one slice at its optimum for fixed (mu, sigma):
+ * negative log-likelihood, gradient and Fisher matrix with respect
+ * to (mu, sigma), and the cross terms needed for the profile
+ * uncertainty of the shared parameters.
+ */
+struct SliceTerms {
+    double nll = 0.0;
+    double grad[2] = {};
+    double fisher[3] = {};      // (mu,mu), (mu,sigma), (sigma,sigma)
+    double area_var = 0.0;
+    double cross_reduction[3] = {};   // C^T H^-1 C, same layout as fisher
+};
+
+struct SliceBasis {
+    const double* x;            // bin centres
+    const double* t;            // scaled coordinate in [-1, 1]
+    int    n_bins;
+    int    n_lin;               // 1 + poly_order + 1
+    double bin_width;
+};
+
+/**
+ * Fit the linear parameters of one slice for fixed (mu, sigma) and
+ * return its likelihood terms. Newton iterations with step halving
+ * to keep the model positive.
+ */
+inline SliceTerms fit_slice(
+    const double* y,
+    const SliceBasis& basis,
+    double mu, double sigma,
+    SliceState& state)
+{
+    const int nb = basis.n_bins;
+    const int nl = basis.n_lin;
+
+    // Peak shape and its derivatives for this (mu, sigma)
+    std::vector<double> g(nb), dg_mu(nb), dg_sigma(nb);
+    const double norm = basis.bin_width / (sqrt_two_pi * sigma);
+    for (int k = 0; k < nb; ++k) {
+        const double u = (basis.x[k] - mu) / sigma;
+        g[k]        = norm * std::exp(-0.5 * u * u);
+        dg_mu[k]    = g[k] * u / sigma;
+        dg_sigma[k] = g[k] * (u * u - 1.0) / sigma;
+    }
+
+    auto phi = [&](int i, int k) -> double {
+        if (i == 0) return g[k];
+        if (i == 1) return 1.0;
+        if (i == 2) return basis.t[k];
+        return basis.t[k] * basis.t[k];
+    };
+
+    double sum_y = 0.0;
+    for (int k = 0; k < nb; ++k)
+        sum_y += y[k];
+
+    SliceTerms terms;
+    if (sum_y <= 0.0) {
+        state.theta.fill(0.0);
+        return terms;
+    }
+
+    std::array<double, 4>& th = state.theta;
+    if (!state.initialized) {
+        th.fill(0.0);
+        th[1] = sum_y / nb;
+        state.initialized = true;
+    }
+
+    auto model = [&](const std::array<double, 4>& p, int k) {
+        double f = 0.0;
+        for (int i = 0; i < nl; ++i)
+            f += p[i] * phi(i, k);
+        return f;
+    };
+
+    auto nll_of = [&](const std::array<double, 4>& p) {
+        double nll = 0.0;
+        for (int k = 0; k < nb; ++k) {
+            const double f = model(p, k);
+            if (f <= 0.0)
+                return std::numeric_limits<double>::infinity();
+            nll += f - (y[k] > 0.0 ? y[k] * std::log(f) : 0.0);
+        }
+        return nll;
+    };
+
+    // A positive start is required by the likelihood
+    if (!std::isfinite(nll_of(th))) {
+        th.fill(0.0);
+        th[1] = sum_y / nb;
+    }
+
+    double H[16];
+    double current = nll_of(th);
+
+    for (int it = 0; it < 30; ++it) {
+        double grad[4] = {};
+        std::fill(H, H + 16, 0.0);
+
+        for (int k = 0; k < nb; ++k) {
+            const double f = model(th, k);
+            const double r = 1.0 - y[k] / f;
+            const double w = std::max(y[k], 1.0) / (f * f);
+            for (int i = 0; i < nl; ++i) {
+                const double pi = phi(i, k);
+                grad[i] += pi * r;
+                for (int j = 0; j <= i; ++j)
+                    H[i * nl + j] += pi * phi(j, k) * w;
+            }
+        }
+        for (int i = 0; i < nl; ++i)
+            for (int j = 0; j < i; ++j)
+                H[j * nl + i] = H[i * nl + j];
+
+        if (!invert_small(nl, H))
+            break;
+
+        std::array<double, 4> step{};
+        for (int i = 0; i < nl; ++i)
+            for (int j = 0; j < nl; ++j)
+                step[i] -= H[i * nl + j] * grad[j];
+
+        double scale = 1.0, trial_nll = current;
+        std::array<double, 4> trial = th;
+        for (int half = 0; half < 20; ++half, scale *= 0.5) {
+            for (int i = 0; i < nl; ++i)
+                trial[i] = th[i] + scale * step[i];
+            trial_nll = nll_of(trial);
+            if (trial_nll <= current)
+                break;
+        }
+        if (!(trial_nll <= current))
+            break;
+
+        const double gain = current - trial_nll;
+        th = trial;
+        current = trial_nll;
+        if (gain < 1e-9 * (1.0 + std::abs(current)))
+            break;
+    }
+
+    // Terms at the optimum: Fisher matrix of the full parameter set
+    // (linear | mu, sigma), using the expected information y -> f
+    double Hll[16] = {}, C[8] = {};
+    for (int k = 0; k < nb; ++k) {
+        const double f = model(th, k);
+        const double r = 1.0 - y[k] / f;
+        const double w = 1.0 / f;
+        const double d_mu    = th[0] * dg_mu[k];
+        const double d_sigma = th[0] * dg_sigma[k];
+
+        terms.grad[0] += d_mu * r;
+        terms.grad[1] += d_sigma * r;
+        terms.fisher[0] += d_mu * d_mu * w;
+        terms.fisher[1] += d_mu * d_sigma * w;
+        terms.fisher[2] += d_sigma * d_sigma * w;
+
+        for (int i = 0; i < nl; ++i) {
+            const double pi = phi(i, k);
+            C[i * 2 + 0] += pi * d_mu * w;
+            C[i * 2 + 1] += pi * d_sigma * w;
+            for (int j = 0; j < nl; ++j)
+                Hll[i * nl + j] += pi * phi(j, k) * w;
+        }
+    }
+    terms.nll = current;
+
+    if (invert_small(nl, Hll)) {
+        terms.area_var = Hll[0];
+        for (int a = 0; a < 2; ++a)
+            for (int b = a; b < 2; ++b) {
+                double s = 0.0;
+                for (int i = 0; i < nl; ++i)
+                    for (int j = 0; j < nl; ++j)
+                        s += C[i * 2 + a] * Hll[i * nl + j] * C[j * 2 + b];
+                terms.cross_reduction[a + b] = s;
+            }
+    }
+
+    return terms;
+}
+
+// ------------------------------------------------------------
+// Simultaneous fit
+// ------------------------------------------------------------
+
+/**
+ * Fit all TOF slices simultaneously.
+ *
+ * counts: n_tof x n_bins, row-major, one row per TOF slice over the
+ *         energy fit range
+ * x:      energy bin centres of the fit range (n_bins, uniform width)
+ *
+ * The area errors are conditional on the fitted (mu, sigma); the
+ * shared-parameter errors are profile errors (all slice parameters
+ * marginalized).
+ */
+inline PeakFitResult fit_peak_slices(
+    const std::vector<double>& counts,
+    int n_tof, int n_bins,
+    const std::vector<double>& x,
+    const PeakFitConfig& cfg)
+{
+    const int order = std::max(0, std::min(cfg.poly_order, 2));
+
+    std::vector<double> t(n_bins);
+    const double x_lo = x.front(), x_hi = x.back();
+    for (int k = 0; k < n_bins; ++k)
+        t[k] = x_hi > x_lo ? 2.0 * (x[k] - x_lo) / (x_hi - x_lo) - 1.0 : 0.0;
+
+    const SliceBasis basis{
+        x.data(), t.data(), n_bins, order + 2,
+        n_bins > 1 ? (x_hi - x_lo) / (n_bins - 1) : 1.0
+    };
+
+    constexpr int chunk = 32;   // slices per work item, sequential inside
+    const size_t n_chunks = (n_tof + chunk - 1) / chunk;
+
+    std::vector<SliceState> states(n_tof), trial_states;
+    std::vector<SliceTerms> terms(n_tof);
+
+    // Evaluate all slices for (mu, sigma); the first slice of a chunk
+    // without a previous solution borrows nothing, later ones start
+    // from their left neighbour.
+    auto evaluate = [&](double mu, double sigma,
+                        std::vector<SliceState>& st,
+                        std::vector<SliceTerms>& out) {
+        parallel_for(n_chunks, [&](size_t c) {
+            const int j0 = static_cast<int>(c) * chunk;
+            const int j1 = std::min(j0 + chunk, n_tof);
+            for (int j = j0; j < j1; ++j) {
+                if (!st[j].initialized && j > j0 && st[j - 1].initialized)
+                    st[j] = st[j - 1];
+                out[j] = fit_slice(&counts[size_t(j) * n_bins], basis,
+                                   mu, sigma, st[j]);
+            }
+        }, cfg.n_threads);
+
+        double nll = 0.0;
+        for (const auto& tm : out)
+            nll += tm.nll;
+        return nll;
+    };
+
+    PeakFitResult result;
+    double mu = cfg.mu_start, sigma = cfg.sigma_start;
+    double nll = evaluate(mu, sigma, states, terms);
+    double lambda = 1e-3;
+
+    for (result.iterations = 0; result.iterations < cfg.max_iter;
+         ++result.iterations) {
+
+        double g[2] = {}, F[3] = {};
+        for (const auto& tm : terms) {
+            g[0] += tm.grad[0];
+            g[1] += tm.grad[1];
+            for (int i = 0; i < 3; ++i)
+                F[i] += tm.fisher[i];
+        }
+
+        bool accepted = false;
+        double d_mu = 0.0, d_sigma = 0.0;
+        for (int attempt = 0; attempt < 10 && !accepted; ++attempt) {
+            const double a = F[0] * (1.0 + lambda), b = F[1];
+            const double c = F[2] * (1.0 + lambda);
+            const double det = a * c - b * b;
+            if (det <= 0.0) {
+                lambda *= 10.0;
+                continue;
+            }
+            d_mu    = -( c * g[0] - b * g[1]) / det;
+            d_sigma = -(-b * g[0] + a * g[1]) / det;
+
+            const double new_sigma = sigma + d_sigma;
+            if (new_sigma <= 0.0) {
+                lambda *= 10.0;
+                continue;
+            }
+
+            trial_states = states;
+            std::vector<SliceTerms> trial_terms(n_tof);
+            const double trial_nll =
+                evaluate(mu + d_mu, new_sigma, trial_states, trial_terms);
+
+            if (trial_nll <= nll) {
+                mu += d_mu;
+                sigma = new_sigma;
+                nll = trial_nll;
+                states.swap(trial_states);
+                terms.swap(trial_terms);
+                lambda = std::max(lambda * 0.1, 1e-9);
+                accepted = true;
+            } else {
+                lambda *= 10.0;
+            }
+        }
+
+        // Converged on a small step, or when no damped step improves
+        // the likelihood any more (minimum within numerical precision)
+        if (!accepted ||
+            std::abs(d_mu) + std::abs(d_sigma) < cfg.tolerance * sigma) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    // Profile covariance of (mu, sigma): Schur complement of the
+    // slice parameters in the full Fisher matrix
+    double P[3] = {};
+    for (const auto& tm : terms)
+        for (int i = 0; i < 3; ++i)
+            P[i] += tm.fisher[i] - tm.cross_reduction[i];
+    const double det = P[0] * P[2] - P[1] * P[1];
+
+    result.mu          = mu;
+    result.sigma       = sigma;
+    result.mu_error    = det > 0.0 ? std::sqrt(P[2] / det) : 0.0;
+    result.sigma_error = det > 0.0 ? std::sqrt(P[0] / det) : 0.0;
+    result.n_bins_fit  = n_bins;
+
+    result.area.yield.resize(n_tof);
+    result.area.error.resize(n_tof);
+    result.background.resize(n_tof);
+    result.deviance.resize(n_tof);
+
+    for (int j = 0; j < n_tof; ++j) {
+        const auto& th = states[j].theta;
+        result.area.yield[j] = th[0];
+        result.area.error[j] = std::sqrt(std::max(terms[j].area_var, 0.0));
+        result.background[j] = {th[1], th[2], th[3]};
+
+        // Poisson deviance 2 * sum(f - y + y ln(y / f))
+        const double* y = &counts[size_t(j) * n_bins];
+        double dev = 0.0;
+        for (int k = 0; k < n_bins; ++k) {
+            double f = th[0] * basis.bin_width
+                     / (sqrt_two_pi * sigma)
+                     * std::exp(-0.5 * std::pow((x[k] - mu) / sigma, 2));
+            for (int i = 1; i < basis.n_lin; ++i)
+                f += th[i] * std::pow(t[k], i - 1);
+            if (f > 0.0)
+                dev += f - y[k] + (y[k] > 0.0 ? y[k] * std::log(y[k] / f) : 0.0);
+        }
+        result.deviance[j] = 2.0 * dev;
+    }
+
+    return result;
+}
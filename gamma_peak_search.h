@@ -0,0 +1,225 @@
+/**
+ *  gamma_peak_search.h
+ *
+ *  Automatic peak search and energy calibration of HPGe spectra,
+ *  so that yield windows can be given in keV and converted to bin
+ *  indices of each run at run time.
+ *
+ *  Peaks are located with a smoothed second-derivative filter
+ *  (Mariscotti-type): the spectrum is convolved with the negative
+ *  second derivative of a Gaussian matched to the peak width, which
+ *  cancels constant and linear backgrounds. A bin is a candidate
+ *  when the filter response is a local maximum and exceeds
+ *  min_significance standard deviations of its Poisson noise.
+ *
+ *  Bin positions use ROOT numbering as a continuous coordinate:
+ *  the centre of energy bin i is at x = i.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "gamma_yield_core.h"
+#include "gamma_gain_match.h"
+
+// ------------------------------------------------------------
+// Peak search
+// ------------------------------------------------------------
+
+struct PeakCandidate {
+    double position;        // bin coordinate, sub-bin precision
+    double significance;    // filter response / its standard deviation
+    double height;          // filter response (counts)
+};
+
+/**
+ * Find peaks in a 1D spectrum (spectrum[0] is ROOT bin 1).
+ * Candidates are returned sorted by position.
+ */
+inline std::vector<PeakCandidate> find_peaks(
+    const std::vector<double>& spectrum,
+    double fwhm_bins,
+    double min_significance = 5.0)
+{
+    const int n = static_cast<int>(spectrum.size());
+    const double sigma = std::max(fwhm_bins / 2.3548, 0.5);
+    const int m = static_cast<int>(std::ceil(3.0 * sigma));
+
+    // Zero-sum kernel: -d2/dx2 of a Gaussian
+    std::vector<double> kernel(2 * m + 1);
+    double mean = 0.0;
+    for (int j = -m; j <= m; ++j) {
+        const double u2 = double(j * j) / (sigma * sigma);
+        kernel[j + m] = (1.0 - u2) * std::exp(-0.5 * u2);
+        mean += kernel[j + m];
+    }
+    mean /= kernel.size();
+    for (double& k : kernel)
+        k -= mean;
+
+    std::vector<PeakCandidate> peaks;
+    if (n < 2 * m + 3)
+        return peaks;
+
+    // Convolution in tap-major order: the inner loop runs over
+    // contiguous bins with a fixed weight, which the compiler
+    // vectorizes without reassociating the sum.
+    std::vector<double> response(n, 0.0), variance(n, 0.0);
+    const int i_begin = m, i_end = n - m;
+    for (int j = -m; j <= m; ++j) {
+        const double w  = kernel[j + m];
+        const double w2 = w * w;
+        const double* y = spectrum.data() + i_begin + j;
+        double* r = response.data() + i_begin;
+        double* v = variance.data() + i_begin;
+        for (int i = 0; i < i_end - i_begin; ++i) {
+            r[i] += w  * y[i];
+            v[i] += w2 * y[i];
+        }
+    }
+
+    for (int i = i_begin + 1; i < i_end - 1; ++i) {
+        const double r = response[i];
+        if (r <= response[i - 1] || r < response[i + 1] || variance[i] <= 0.0)
+            continue;
+
+        const double significance = r / std::sqrt(variance[i]);
+        if (significance < min_significance)
+            continue;
+
+        // Parabolic interpolation of the response maximum
+        const double curv = response[i - 1] - 2.0 * r + response[i + 1];
+        const double delta =
+            curv < 0.0 ? 0.5 * (response[i - 1] - response[i + 1]) / curv : 0.0;
+
+        peaks.push_back({i + 1 + delta, significance, r});
+    }
+
+    return peaks;
+}
+
+// ------------------------------------------------------------
+// Energy calibration
+// ------------------------------------------------------------
+
+struct CalibrationFit {
+    EnergyCalibration cal;          // E(x), x = bin coordinate
+    std::vector<double> matched_keV;
+    std::vector<double> matched_position;
+    double rms_keV = 0.0;
+    bool   ok      = false;
+};
+
+/**
+ * Match peak candidates to reference lines and fit E(x) of the
+ * given order (1 or 2) by least squares.
+ *
+ * guess maps bin coordinates to approximate energies (e.g. the
+ * nominal axis calibration); for each reference line the most
+ * significant candidate within tolerance_keV of it is used.
+ */
+inline CalibrationFit calibrate_energy(
+    const std::vector<PeakCandidate>& peaks,
+    const std::vector<double>& reference_keV,
+    const EnergyCalibration& guess,
+    double tolerance_keV,
+    int order = 1)
+{
+    CalibrationFit fit;
+    order = std::max(1, std::min(order, 2));
+
+    for (double e_ref : reference_keV) {
+        const PeakCandidate* best = nullptr;
+        for (const auto& p : peaks)
+            if (std::abs(guess(p.position) - e_ref) < tolerance_keV &&
+                (!best || p.significance > best->significance))
+                best = &p;
+        if (best) {
+            fit.matched_keV.push_back(e_ref);
+            fit.matched_position.push_back(best->position);
+        }
+    }
+
+    const int np = order + 1;
+    const size_t n = fit.matched_keV.size();
+    if (n < static_cast<size_t>(np))
+        return fit;
+
+    // Normal equations in powers of x
+    double A[16] = {}, b[4] = {};
+    for (size_t i = 0; i < n; ++i) {
+        double xk[5] = {1.0};
+        for (int k = 1; k < 2 * np - 1; ++k)
+            xk[k] = xk[k - 1] * fit.matched_position[i];
+        for (int r = 0; r < np; ++r) {
+            b[r] += xk[r] * fit.matched_keV[i];
+            for (int c = 0; c < np; ++c)
+                A[r * np + c] += xk[r + c];
+        }
+    }
+    if (!invert_small(np, A))
+        return fit;
+
+    double coef[3] = {};
+    for (int r = 0; r < np; ++r)
+        for (int c = 0; c < np; ++c)
+            coef[r] += A[r * np + c] * b[c];
+
+    fit.cal = EnergyCalibration{coef[0], coef[1], coef[2]};
+
+    double ss = 0.0;
+    for (size_t i = 0; i < n; ++i)
+        ss += std::pow(fit.cal(fit.matched_position[i]) - fit.matched_keV[i], 2);
+    fit.rms_keV = std::sqrt(ss / n);
+    fit.ok = true;
+
+    return fit;
+}
+
+/**
+ * Inverse of an increasing calibration: bin coordinate of energy
+ * e_keV, using the cancellation-free root of the quadratic.
+ */
+inline double energy_to_bin(const EnergyCalibration& cal, double e_keV)
+{
+    const double d = e_keV - cal.c0;
+    if (cal.c2 == 0.0)
+        return d / cal.c1;
+    return 2.0 * d / (cal.c1 + std::sqrt(cal.c1 * cal.c1 + 4.0 * cal.c2 * d));
+}
+
+// ------------------------------------------------------------
+// Windows in keV
+// ------------------------------------------------------------
+
+struct YieldWindowsKeV {
+    std::string name;
+    double peak_min, peak_max;
+    double bkgL_min, bkgL_max;
+    double bkgR_min, bkgR_max;
+};
+
+/**
+ * Convert keV windows to bin windows for one run's calibration.
+ * Each limit becomes the bin whose centre is nearest to it.
+ */
+inline YieldWindows to_bin_windows(const YieldWindowsKeV& w,
+                                   const EnergyCalibration& cal)
+{
+    auto bin = [&](double e) {
+        return static_cast<int>(std::lround(energy_to_bin(cal, e)));
+    };
+
+    return YieldWindows{
+        w.name,
+        bin(w.peak_min), bin(w.peak_max),
+        bin(w.bkgL_min), bin(w.bkgL_max),
+        bin(w.bkgR_min), bin(w.bkgR_max)
+    };
+}
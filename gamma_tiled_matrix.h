@@ -0,0 +1,372 @@
+/**
+ *  gamma_tiled_matrix.h
+ *
+ *  Out-of-core TOF-energy matrices for binnings that do not fit in
+ *  memory as a TH2F. The matrix is stored in a memory-mapped file
+ *  (.gyt) as tiles of tile_tof TOF bins x tile_energy energy bins,
+ *  with double or uint64 counts (uint64 keeps summed runs exact).
+ *
+ *  Yield extraction streams the matrix TOF band by TOF band: a band
+ *  reads only the energy tiles that overlap the yield windows, and
+ *  its pages are released afterwards, so resident memory stays at
+ *  a few bands per thread regardless of the matrix size.
+ *
+ *  POSIX only (mmap).
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// File layout
+// ------------------------------------------------------------
+
+enum class TileCountType : int32_t {
+    Double = 0,
+    UInt64 = 1
+};
+
+//  Header (one page), followed by the tiles band-major: band b
+//  (TOF bins b * tile_tof + 1 ..) holds its energy tiles in order,
+//  each tile_tof x tile_energy values, row-major. Energy bins
+//  include under/overflow (ROOT numbering 0 .. n_energy + 1); tiles
+//  at the matrix edges are zero-padded to full size.
+struct TiledMatrixHeader {
+    char    magic[8];           // "GYTILE01"
+    int32_t n_tof;
+    int32_t n_energy;
+    int32_t tile_tof;
+    int32_t tile_energy;
+    TileCountType count_type;
+    int32_t reserved;
+    double  tof_min, tof_max;           // ns
+    double  energy_min, energy_max;
+};
+
+constexpr char   tiled_matrix_magic[8] = {'G', 'Y', 'T', 'I', 'L', 'E', '0', '1'};
+constexpr size_t tiled_matrix_header_size = 4096;
+
+// ------------------------------------------------------------
+// Memory-mapped matrix
+// ------------------------------------------------------------
+
+struct TiledMatrix {
+    TiledMatrixHeader header{};
+
+    TiledMatrix() = default;
+    TiledMatrix(const TiledMatrix&) = delete;
+    TiledMatrix& operator=(const TiledMatrix&) = delete;
+    ~TiledMatrix() { close(); }
+
+    int n_tof()    const { return header.n_tof; }
+    int n_energy() const { return header.n_energy; }
+    int n_bands()  const { return (header.n_tof + header.tile_tof - 1) / header.tile_tof; }
+    int n_energy_tiles() const
+    {
+        return (header.n_energy + 2 + header.tile_energy - 1) / header.tile_energy;
+    }
+
+    /**
+     * Create a zero-filled matrix file and map it for writing.
+     * tile_tof * tile_energy should be a multiple of 512 so that
+     * tiles start on page boundaries.
+     */
+    bool create(const std::string& path,
+                int n_tof, double tof_min, double tof_max,
+                int n_energy, double energy_min, double energy_max,
+                TileCountType count_type = TileCountType::UInt64,
+                int tile_tof = 256, int tile_energy = 512)
+    {
+        close();
+
+        std::memcpy(header.magic, tiled_matrix_magic, sizeof(header.magic));
+        header.n_tof       = n_tof;
+        header.n_energy    = n_energy;
+        header.tile_tof    = tile_tof;
+        header.tile_energy = tile_energy;
+        header.count_type  = count_type;
+        header.reserved    = 0;
+        header.tof_min     = tof_min;
+        header.tof_max     = tof_max;
+        header.energy_min  = energy_min;
+        header.energy_max  = energy_max;
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            return false;
+
+        size_ = tiled_matrix_header_size + n_bands() * band_bytes();
+        if (::ftruncate(fd_, static_cast<off_t>(size_)) != 0 ||
+            !map(true)) {
+            close();
+            return false;
+        }
+        std::memcpy(data_, &header, sizeof(header));
+        return true;
+    }
+
+    /**
+     * Map an existing matrix file (read-only unless writable).
+     */
+    bool open(const std::string& path, bool writable = false)
+    {
+        close();
+
+        fd_ = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+        if (fd_ < 0)
+            return false;
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 ||
+            static_cast<size_t>(st.st_size) < tiled_matrix_header_size ||
+            ::pread(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+            std::memcmp(header.magic, tiled_matrix_magic, sizeof(header.magic)) != 0 ||
+            header.n_tof <= 0 || header.n_energy <= 0 ||
+            header.tile_tof <= 0 || header.tile_energy <= 0) {
+            close();
+            return false;
+        }
+
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ < tiled_matrix_header_size + n_bands() * band_bytes() ||
+            !map(writable)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data_)
+            ::munmap(data_, size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        data_ = nullptr;
+        fd_   = -1;
+        size_ = 0;
+    }
+
+    /**
+     * Add counts to bin (ib, ie) (TOF 1-based, energy ROOT numbering).
+     * uint64 matrices round to the nearest integer. Not thread-safe
+     * for the same bin.
+     */
+    void add(int ib, int ie, double counts)
+    {
+        char* cell = data_ + cell_offset(ib, ie);
+        if (header.count_type == TileCountType::UInt64)
+            *reinterpret_cast<uint64_t*>(cell) +=
+                static_cast<uint64_t>(std::llround(counts));
+        else
+            *reinterpret_cast<double*>(cell) += counts;
+    }
+
+    double value(int ib, int ie) const
+    {
+        const char* cell = data_ + cell_offset(ib, ie);
+        return header.count_type == TileCountType::UInt64
+             ? static_cast<double>(*reinterpret_cast<const uint64_t*>(cell))
+             : *reinterpret_cast<const double*>(cell);
+    }
+
+    /**
+     * Copy energy bins [e_lo, e_hi] of every TOF bin in band b into
+     * out (row-major, rows of e_hi - e_lo + 1 values; the last band
+     * may have fewer rows). Returns the number of rows. Only the
+     * tiles overlapping [e_lo, e_hi] are touched.
+     */
+    int read_band(int b, int e_lo, int e_hi, double* out) const
+    {
+        const int ib0  = b * header.tile_tof + 1;
+        const int rows = std::min(header.tile_tof, header.n_tof - ib0 + 1);
+        const int span = e_hi - e_lo + 1;
+
+        for (int t = e_lo / header.tile_energy;
+             t <= e_hi / header.tile_energy; ++t) {
+            const int t_lo = std::max(e_lo, t * header.tile_energy);
+            const int t_hi = std::min(e_hi, (t + 1) * header.tile_energy - 1);
+            const char* tile = data_ + tile_offset(b, t);
+
+            for (int r = 0; r < rows; ++r) {
+                const size_t first =
+                    size_t(r) * header.tile_energy + (t_lo - t * header.tile_energy);
+                double* dst = out + size_t(r) * span + (t_lo - e_lo);
+
+                if (header.count_type == TileCountType::UInt64) {
+                    const uint64_t* src =
+                        reinterpret_cast<const uint64_t*>(tile) + first;
+                    for (int k = 0; k <= t_hi - t_lo; ++k)
+                        dst[k] = static_cast<double>(src[k]);
+                } else {
+                    const double* src =
+                        reinterpret_cast<const double*>(tile) + first;
+                    std::copy(src, src + (t_hi - t_lo + 1), dst);
+                }
+            }
+        }
+        return rows;
+    }
+
+    /**
+     * Drop the mapped pages of band b from resident memory. The data
+     * stays in the file (and page cache) and is mapped again on the
+     * next access.
+     */
+    void release_band(int b) const
+    {
+        const size_t page  = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const size_t begin = tile_offset(b, 0) / page * page;
+        const size_t end   = std::min(tile_offset(b, 0) + band_bytes(), size_);
+        ::madvise(data_ + begin, end - begin, MADV_DONTNEED);
+    }
+
+    std::vector<double> tof_edges() const
+    {
+        std::vector<double> edges(header.n_tof + 1);
+        for (int i = 0; i <= header.n_tof; ++i)
+            edges[i] = header.tof_min
+                     + (header.tof_max - header.tof_min) * i / header.n_tof;
+        return edges;
+    }
+
+private:
+    int    fd_   = -1;
+    char*  data_ = nullptr;
+    size_t size_ = 0;
+
+    size_t tile_bytes() const
+    {
+        return size_t(header.tile_tof) * header.tile_energy * 8;
+    }
+    size_t band_bytes() const { return n_energy_tiles() * tile_bytes(); }
+
+    size_t tile_offset(int b, int t) const
+    {
+        return tiled_matrix_header_size
+             + (size_t(b) * n_energy_tiles() + t) * tile_bytes();
+    }
+
+    size_t cell_offset(int ib, int ie) const
+    {
+        const int b = (ib - 1) / header.tile_tof;
+        const int r = (ib - 1) % header.tile_tof;
+        const int t = ie / header.tile_energy;
+        const int k = ie % header.tile_energy;
+        return tile_offset(b, t)
+             + (size_t(r) * header.tile_energy + k) * 8;
+    }
+
+    bool map(bool writable)
+    {
+        void* p = ::mmap(nullptr, size_,
+                         writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                         MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED)
+            return false;
+        data_ = static_cast<char*>(p);
+        return true;
+    }
+};
+
+// ------------------------------------------------------------
+// Streaming extraction
+// ------------------------------------------------------------
+
+/**
+ * Side-band extraction of several lines from a tiled matrix.
+ *
+ * TOF bands are the parallel work items. Each band copies the
+ * energy range spanned by all windows into a small buffer, builds
+ * its cumulative sums there (a WindowSumTable over that range, with
+ * the windows shifted accordingly) and extracts every line, then
+ * releases its pages. Results equal extract_yields() on the full
+ * matrix.
+ */
+inline std::vector<YieldResult> extract_yields(
+    const TiledMatrix& matrix,
+    const std::vector<YieldWindows>& lines,
+    unsigned n_threads = 0
+)
+{
+    const int n_tof = matrix.n_tof();
+
+    std::vector<YieldResult> results(lines.size());
+    for (auto& r : results) {
+        r.yield.resize(n_tof, 0.0);
+        r.error.resize(n_tof, 0.0);
+    }
+    if (lines.empty())
+        return results;
+
+    // Energy range read per band, clamped like WindowSumTable::integral
+    int e_lo = matrix.n_energy() + 1, e_hi = 0;
+    for (const auto& w : lines) {
+        e_lo = std::min({e_lo, w.peak_min, w.bkgL_min, w.bkgR_min});
+        e_hi = std::max({e_hi, w.peak_max, w.bkgL_max, w.bkgR_max});
+    }
+    e_lo = std::max(e_lo, 0);
+    e_hi = std::min(e_hi, matrix.n_energy() + 1);
+    if (e_hi < e_lo)
+        return results;
+
+    const int span = e_hi - e_lo + 1;
+
+    std::vector<YieldWindows> shifted(lines);
+    for (auto& w : shifted) {
+        w.peak_min -= e_lo;  w.peak_max -= e_lo;
+        w.bkgL_min -= e_lo;  w.bkgL_max -= e_lo;
+        w.bkgR_min -= e_lo;  w.bkgR_max -= e_lo;
+    }
+
+    parallel_for(matrix.n_bands(), [&](size_t b) {
+        const int ib0 = static_cast<int>(b) * matrix.header.tile_tof + 1;
+
+        std::vector<double> buffer(size_t(matrix.header.tile_tof) * span);
+        const int rows = matrix.read_band(static_cast<int>(b), e_lo, e_hi,
+                                          buffer.data());
+        matrix.release_band(static_cast<int>(b));
+
+        WindowSumTable table;
+        table.n_tof    = rows;
+        table.n_energy = span - 2;
+        table.cumsum.assign(size_t(rows) * (span + 1), 0.0);
+        for (int r = 0; r < rows; ++r) {
+            const double* in = &buffer[size_t(r) * span];
+            double* cum = &table.cumsum[size_t(r) * (span + 1)];
+            double sum = 0.0;
+            for (int k = 0; k < span; ++k) {
+                sum += in[k];
+                cum[k + 1] = sum;
+            }
+        }
+
+        YieldResult part;
+        part.yield.resize(rows);
+        part.error.resize(rows);
+        for (size_t l = 0; l < lines.size(); ++l) {
+            extract_yield_bins(table, shifted[l], 1, rows, part);
+            std::copy(part.yield.begin(), part.yield.end(),
+                      results[l].yield.begin() + (ib0 - 1));
+            std::copy(part.error.begin(), part.error.end(),
+                      results[l].error.begin() + (ib0 - 1));
+        }
+    }, n_threads);
+
+    return results;
+}
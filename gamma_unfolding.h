@@ -0,0 +1,328 @@
+/**
+ *  gamma_unfolding.h
+ *
+ *  Unfolding of the TOF resolution from net yields. At high neutron
+ *  energies the time resolution (pulse width, moderation-length
+ *  spread) is comparable to the TOF bin width and smears the yield
+ *  into neighbouring bins.
+ *
+ *  The response is a sparse banded matrix R (measured bin i, true
+ *  bin j) built from a Gaussian resolution in time,
+ *    sigma_t(t)^2 = sigma_time^2 + (t * sigma_length / L)^2,
+ *  with L = constants::flight_path. The unfolded yield minimizes
+ *    (y - R x)^T W (y - R x) + tau * |D2 x|^2
+ *  (W = inverse yield variances, D2 = second differences), solved by
+ *  conjugate gradients. The threads go to the error calculation,
+ *  one independent CG solve per bin; a single solve is serial
+ *  unless its matrix is large (see SparseMatrix::multiply), since
+ *  parallel_for starts fresh threads on every call and CG makes two
+ *  products per iteration. Negative net yields are handled
+ *  naturally, unlike multiplicative methods.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// Sparse matrix
+// ------------------------------------------------------------
+
+/**
+ * Compressed sparse row matrix.
+ */
+struct SparseMatrix {
+    int n_rows = 0;
+    int n_cols = 0;
+    std::vector<size_t> row_ptr;        // n_rows + 1
+    std::vector<int>    col;
+    std::vector<double> val;
+
+    // Below this many non-zeros (well under a millisecond of work)
+    // starting threads costs more than the product itself
+    static constexpr size_t parallel_min_nonzeros = size_t(1) << 18;
+
+    void multiply_rows(const double* x, double* y, int r0, int r1) const
+    {
+        for (int r = r0; r < r1; ++r) {
+            double sum = 0.0;
+            for (size_t k = row_ptr[r]; k < row_ptr[r + 1]; ++k)
+                sum += val[k] * x[col[k]];
+            y[r] = sum;
+        }
+    }
+
+    /**
+     * y = M x. Serial unless the matrix has parallel_min_nonzeros
+     * or more; then the rows are split evenly over the threads.
+     */
+    void multiply(const double* x, double* y, unsigned n_threads = 0) const
+    {
+        if (n_threads == 0)
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        if (n_threads == 1 || val.size() < parallel_min_nonzeros) {
+            multiply_rows(x, y, 0, n_rows);
+            return;
+        }
+
+        const int chunk = static_cast<int>((n_rows + n_threads - 1) / n_threads);
+        parallel_for(n_threads, [&](size_t c) {
+            const int r0 = std::min(static_cast<int>(c) * chunk, n_rows);
+            multiply_rows(x, y, r0, std::min(r0 + chunk, n_rows));
+        }, n_threads);
+    }
+};
+
+inline SparseMatrix transpose(const SparseMatrix& m)
+{
+    SparseMatrix t;
+    t.n_rows = m.n_cols;
+    t.n_cols = m.n_rows;
+    t.row_ptr.assign(t.n_rows + 1, 0);
+    t.col.resize(m.col.size());
+    t.val.resize(m.val.size());
+
+    for (int c : m.col)
+        ++t.row_ptr[c + 1];
+    for (int r = 0; r < t.n_rows; ++r)
+        t.row_ptr[r + 1] += t.row_ptr[r];
+
+    std::vector<size_t> fill(t.row_ptr.begin(), t.row_ptr.end() - 1);
+    for (int r = 0; r < m.n_rows; ++r)
+        for (size_t k = m.row_ptr[r]; k < m.row_ptr[r + 1]; ++k) {
+            const size_t dst = fill[m.col[k]]++;
+            t.col[dst] = r;
+            t.val[dst] = m.val[k];
+        }
+
+    return t;
+}
+
+// ------------------------------------------------------------
+// TOF response
+// ------------------------------------------------------------
+
+struct TofResolution {
+    double sigma_time_ns  = 5.0;    // pulse width and timing
+    double sigma_length_m = 0.0;    // moderation-length spread
+    double n_sigma        = 5.0;    // band half-width
+};
+
+/**
+ * Response matrix for TOF bin edges (ns): R[i][j] is the probability
+ * that a yield at the centre of true bin j is measured in bin i.
+ * Built column-wise (one Gaussian per true bin), stored by rows.
+ */
+inline SparseMatrix build_tof_response(
+    const std::vector<double>& tof_edges,
+    const TofResolution& res,
+    double flight_path = constants::flight_path)
+{
+    const int n = static_cast<int>(tof_edges.size()) - 1;
+
+    // Column-wise (true bin) construction, CSR of R^T
+    SparseMatrix rt;
+    rt.n_rows = n;
+    rt.n_cols = n;
+    rt.row_ptr.push_back(0);
+
+    for (int j = 0; j < n; ++j) {
+        const double t = 0.5 * (tof_edges[j] + tof_edges[j + 1]);
+        const double st = t * res.sigma_length_m / flight_path;
+        const double sigma =
+            std::sqrt(res.sigma_time_ns * res.sigma_time_ns + st * st);
+        const double lo = t - res.n_sigma * sigma;
+        const double hi = t + res.n_sigma * sigma;
+
+        const int i0 = std::max(0, static_cast<int>(
+            std::upper_bound(tof_edges.begin(), tof_edges.end(), lo)
+            - tof_edges.begin()) - 1);
+
+        for (int i = i0; i < n && tof_edges[i] < hi; ++i) {
+            const double a = (tof_edges[i] - t) / (sigma * std::sqrt(2.0));
+            const double b = (tof_edges[i + 1] - t) / (sigma * std::sqrt(2.0));
+            const double p = 0.5 * (std::erfc(a) - std::erfc(b));
+            if (p > 1e-12) {
+                rt.col.push_back(i);
+                rt.val.push_back(p);
+            }
+        }
+        rt.row_ptr.push_back(rt.col.size());
+    }
+
+    return transpose(rt);
+}
+
+// ------------------------------------------------------------
+// Regularized unfolding
+// ------------------------------------------------------------
+
+struct UnfoldingConfig {
+    double tau       = 1e-2;    // regularization, relative to mean(diag R^T W R)
+    int    max_iter  = 1000;    // conjugate-gradient iterations
+    double tolerance = 1e-10;   // relative residual norm
+    bool   errors    = true;    // diagonal of the unfolded covariance
+    unsigned n_threads = 0;
+};
+
+struct UnfoldingResult {
+    YieldResult unfolded;
+    int  iterations = 0;
+    bool converged  = false;
+};
+
+/**
+ * Operator A = R^T W R + tau D2^T D2 of the normal equations.
+ */
+struct UnfoldingOperator {
+    const SparseMatrix& R;
+    const SparseMatrix& RT;
+    std::vector<double> w;          // inverse variances
+    double tau = 0.0;
+
+    mutable std::vector<double> tmp;
+
+    void apply(const std::vector<double>& x, std::vector<double>& out,
+               unsigned n_threads) const
+    {
+        tmp.resize(R.n_rows);
+        R.multiply(x.data(), tmp.data(), n_threads);
+        for (int i = 0; i < R.n_rows; ++i)
+            tmp[i] *= w[i];
+        RT.multiply(tmp.data(), out.data(), n_threads);
+
+        // Second-difference penalty D2^T D2 x (5-point stencil)
+        const int n = static_cast<int>(x.size());
+        std::vector<double> d(std::max(n - 2, 0));
+        for (int k = 0; k + 2 < n; ++k)
+            d[k] = x[k] - 2.0 * x[k + 1] + x[k + 2];
+        for (int k = 0; k + 2 < n; ++k) {
+            out[k]     += tau * d[k];
+            out[k + 1] -= 2.0 * tau * d[k];
+            out[k + 2] += tau * d[k];
+        }
+    }
+};
+
+/**
+ * Conjugate-gradient solve of A x = b, starting from x.
+ */
+inline int solve_cg(const UnfoldingOperator& A,
+                    const std::vector<double>& b,
+                    std::vector<double>& x,
+                    int max_iter, double tolerance,
+                    unsigned n_threads, bool& converged)
+{
+    const size_t n = b.size();
+    std::vector<double> r(n), p(n), Ap(n);
+
+    A.apply(x, Ap, n_threads);
+    double bb = 0.0, rr = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        r[i] = b[i] - Ap[i];
+        p[i] = r[i];
+        rr += r[i] * r[i];
+        bb += b[i] * b[i];
+    }
+
+    converged = false;
+    const double target = tolerance * tolerance * std::max(bb, 1e-300);
+    int it = 0;
+    for (; it < max_iter; ++it) {
+        if (rr <= target) {
+            converged = true;
+            break;
+        }
+
+        A.apply(p, Ap, n_threads);
+        double pAp = 0.0;
+        for (size_t i = 0; i < n; ++i)
+            pAp += p[i] * Ap[i];
+        if (pAp <= 0.0)
+            break;
+
+        const double alpha = rr / pAp;
+        double rr_new = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * Ap[i];
+            rr_new += r[i] * r[i];
+        }
+
+        const double beta = rr_new / rr;
+        for (size_t i = 0; i < n; ++i)
+            p[i] = r[i] + beta * p[i];
+        rr = rr_new;
+    }
+
+    return it;
+}
+
+/**
+ * Unfold measured yields (binned like the response rows).
+ *
+ * Errors, when requested, are the square roots of the diagonal of
+ * A^-1 R^T W R A^-1, computed with one CG solve per bin (columns are
+ * distributed over threads).
+ */
+inline UnfoldingResult unfold_yield(
+    const YieldResult& measured,
+    const SparseMatrix& R,
+    const UnfoldingConfig& cfg)
+{
+    const int n = R.n_cols;
+    const SparseMatrix RT = transpose(R);
+
+    UnfoldingOperator A{R, RT, std::vector<double>(R.n_rows, 0.0), 0.0, {}};
+    for (int i = 0; i < R.n_rows; ++i) {
+        const double e = measured.error[i];
+        A.w[i] = e > 0.0 ? 1.0 / (e * e) : 0.0;
+    }
+
+    // Scale tau by the mean diagonal of R^T W R
+    double diag_sum = 0.0;
+    for (int j = 0; j < n; ++j)
+        for (size_t k = RT.row_ptr[j]; k < RT.row_ptr[j + 1]; ++k)
+            diag_sum += RT.val[k] * RT.val[k] * A.w[RT.col[k]];
+    A.tau = cfg.tau * diag_sum / std::max(n, 1);
+
+    std::vector<double> wy(R.n_rows), b(n);
+    for (int i = 0; i < R.n_rows; ++i)
+        wy[i] = A.w[i] * measured.yield[i];
+    RT.multiply(wy.data(), b.data(), cfg.n_threads);
+
+    UnfoldingResult result;
+    result.unfolded.yield = measured.yield;     // start from the data
+    result.unfolded.yield.resize(n, 0.0);
+    result.iterations = solve_cg(A, b, result.unfolded.yield,
+                                 cfg.max_iter, cfg.tolerance,
+                                 cfg.n_threads, result.converged);
+
+    result.unfolded.error.assign(n, 0.0);
+    if (!cfg.errors)
+        return result;
+
+    // Column j of A^-1, then var_j = z^T (R^T W R) z with z = A^-1 e_j
+    parallel_for(n, [&](size_t j) {
+        UnfoldingOperator Aj{R, RT, A.w, A.tau, {}};
+        std::vector<double> e(n, 0.0), z(n, 0.0), Rz(R.n_rows);
+        e[j] = 1.0;
+        bool ok;
+        solve_cg(Aj, e, z, cfg.max_iter, cfg.tolerance, 1, ok);
+
+        R.multiply(z.data(), Rz.data(), 1);
+        double var = 0.0;
+        for (int i = 0; i < R.n_rows; ++i)
+            var += Rz[i] * Rz[i] * A.w[i];
+        result.unfolded.error[j] = std::sqrt(var);
+    }, cfg.n_threads);
+
+    return result;
+}
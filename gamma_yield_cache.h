@@ -0,0 +1,407 @@
+/**
+ *  gamma_yield_cache.h
+ *
+ *  Content-addressed on-disk cache of extraction results. The key
+ *  is a 128-bit hash of the input matrix (contents and axes), the
+ *  window list and a method tag, so unchanged inputs return their
+ *  stored YieldResult vectors without re-extraction, whatever file
+ *  or histogram name they come from.
+ *
+ *  Entries are files <key>.gyc in the cache directory, written to a
+ *  temporary name and renamed, so concurrent writers never expose a
+ *  partial entry. The directory size is scanned once when the cache
+ *  is opened and then tracked on every store and removal; only when
+ *  it exceeds max_bytes is the directory rescanned and the least
+ *  recently used entries (by modification time, refreshed on every
+ *  hit) removed, down to 90% of max_bytes so the next few stores do
+ *  not evict again. Entries written by other processes are only
+ *  counted at the next rescan.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gamma_yield_core.h"
+#include "gamma_histogram.h"
+
+// ------------------------------------------------------------
+// Content hash
+// ------------------------------------------------------------
+
+/**
+ * Streaming 128-bit hash over 8-byte words. Four independent lanes
+ * (one splitmix64 chain each) keep the multiplies pipelined, so
+ * hashing runs near memory bandwidth. Not cryptographic.
+ */
+struct ContentHash {
+    uint64_t lane[4] = {0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL,
+                        0xa4093822299f31d0ULL, 0x082efa98ec4e6c89ULL};
+    uint64_t n_bytes = 0;
+
+    void update(const void* data, size_t size)
+    {
+        const char* p = static_cast<const char*>(data);
+        const size_t n_blocks = size / 32;
+
+        for (size_t i = 0; i < n_blocks; ++i, p += 32) {
+            uint64_t w[4];
+            std::memcpy(w, p, 32);
+            for (int k = 0; k < 4; ++k)
+                lane[k] = splitmix64(lane[k] ^ w[k]);
+        }
+
+        // Tail: remaining bytes, zero-padded, into lane 0
+        for (size_t rest = size - n_blocks * 32; rest > 0; ) {
+            uint64_t w = 0;
+            const size_t n = std::min<size_t>(rest, 8);
+            std::memcpy(&w, p, n);
+            lane[0] = splitmix64(lane[0] ^ w);
+            p += n;
+            rest -= n;
+        }
+
+        n_bytes += size;
+    }
+
+    template <typename T>
+    void update_value(const T& value) { update(&value, sizeof(value)); }
+
+    void update_string(const std::string& s)
+    {
+        update_value(s.size());
+        update(s.data(), s.size());
+    }
+
+    /**
+     * 32 hex digits.
+     */
+    std::string hex() const
+    {
+        const uint64_t a = splitmix64(lane[0] ^ splitmix64(lane[1] ^ n_bytes));
+        const uint64_t b = splitmix64(lane[2] ^ splitmix64(lane[3] ^ a));
+
+        static const char digits[] = "0123456789abcdef";
+        std::string out(32, '0');
+        for (int i = 0; i < 16; ++i) {
+            out[15 - i] = digits[(a >> (4 * i)) & 0xf];
+            out[31 - i] = digits[(b >> (4 * i)) & 0xf];
+        }
+        return out;
+    }
+};
+
+/**
+ * Add the window limits of all lines (names are labels only and do
+ * not change the result, so they are not hashed).
+ */
+inline void hash_windows(ContentHash& hash,
+                         const std::vector<YieldWindows>& lines)
+{
+    hash.update_value(lines.size());
+    for (const auto& w : lines) {
+        const int32_t limits[6] = {w.peak_min, w.peak_max,
+                                   w.bkgL_min, w.bkgL_max,
+                                   w.bkgR_min, w.bkgR_max};
+        hash.update(limits, sizeof(limits));
+    }
+}
+
+// ------------------------------------------------------------
+// Cache
+// ------------------------------------------------------------
+
+struct YieldCacheConfig {
+    std::string directory = ".gamma_yield_cache";
+    uint64_t    max_bytes = uint64_t(1) << 30;     // 1 GiB
+};
+
+//  Entry file:
+//    char     magic[8]  "GYCACHE1"
+//    uint64   n_results
+//    per result: uint64 n, double yield[n], double error[n]
+constexpr char yield_cache_magic[8] = {'G', 'Y', 'C', 'A', 'C', 'H', 'E', '1'};
+
+struct YieldCache {
+    YieldCacheConfig config;
+
+    explicit YieldCache(const YieldCacheConfig& cfg = YieldCacheConfig{})
+        : config(cfg)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(config.directory, ec);
+        total_bytes_ = scan_entries(nullptr);
+    }
+
+    std::filesystem::path entry_path(const std::string& key) const
+    {
+        return std::filesystem::path(config.directory) / (key + ".gyc");
+    }
+
+    /**
+     * Load the results stored under key; refreshes the entry's
+     * modification time for LRU eviction. Returns false on a miss.
+     * Truncated or corrupt entries (counts that do not fit the file
+     * size) are removed and count as a miss.
+     */
+    bool load(const std::string& key, std::vector<YieldResult>& results) const
+    {
+        const auto path = entry_path(key);
+        try {
+            std::error_code ec;
+            const uint64_t file_size = std::filesystem::file_size(path, ec);
+            if (ec)
+                return false;
+
+            std::vector<YieldResult> loaded;
+            if (!read_entry(path, file_size, loaded)) {
+                if (std::filesystem::remove(path, ec)) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    total_bytes_ -= std::min(total_bytes_, file_size);
+                }
+                return false;
+            }
+
+            std::filesystem::last_write_time(
+                path, std::filesystem::file_time_type::clock::now(), ec);
+
+            results = std::move(loaded);
+            return true;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    /**
+     * Store results under key; evicts if the cache then exceeds
+     * max_bytes.
+     * Safe to call from several threads.
+     */
+    void store(const std::string& key, const std::vector<YieldResult>& results)
+    {
+        static std::atomic<uint64_t> counter{0};
+        const auto path = entry_path(key);
+        const auto tmp = path.string() + ".tmp"
+                       + std::to_string(std::hash<std::thread::id>{}(
+                             std::this_thread::get_id()))
+                       + "_" + std::to_string(counter++);
+
+        {
+            std::ofstream out(tmp, std::ios::binary);
+            const uint64_t n_results = results.size();
+            out.write(yield_cache_magic, sizeof(yield_cache_magic));
+            out.write(reinterpret_cast<const char*>(&n_results), sizeof(n_results));
+            for (const auto& r : results) {
+                const uint64_t n = r.yield.size();
+                out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+                out.write(reinterpret_cast<const char*>(r.yield.data()), n * sizeof(double));
+                out.write(reinterpret_cast<const char*>(r.error.data()), n * sizeof(double));
+            }
+            if (!out) {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return;
+            }
+        }
+
+        std::error_code ec;
+        const uint64_t new_size = std::filesystem::file_size(tmp, ec);
+        uint64_t old_size = std::filesystem::file_size(path, ec);
+        if (ec)
+            old_size = 0;
+
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+
+        bool over_limit = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            total_bytes_ += new_size;
+            total_bytes_ -= std::min(total_bytes_, old_size);
+            over_limit = total_bytes_ > config.max_bytes;
+        }
+        if (over_limit)
+            evict();
+    }
+
+    /**
+     * Rescan the directory and remove least recently used entries
+     * until the cache holds at most 90% of max_bytes.
+     */
+    void evict()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<Entry> entries;
+        uint64_t total = scan_entries(&entries);
+        const uint64_t target = config.max_bytes / 10 * 9;
+
+        if (total > config.max_bytes) {
+            std::sort(entries.begin(), entries.end(),
+                      [](const Entry& a, const Entry& b) { return a.time < b.time; });
+            for (const auto& e : entries) {
+                if (total <= target)
+                    break;
+                std::error_code rec;
+                if (std::filesystem::remove(e.path, rec))
+                    total -= e.size;
+            }
+        }
+
+        total_bytes_ = total;
+    }
+
+    /**
+     * Bytes currently held by the cache, as tracked by this process.
+     */
+    uint64_t size_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return total_bytes_;
+    }
+
+private:
+    struct Entry {
+        std::filesystem::file_time_type time;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+
+    mutable std::mutex mutex_;      // guards total_bytes_ and eviction
+    mutable uint64_t total_bytes_ = 0;
+
+    /**
+     * Total size of all entry files; lists them in entries if given.
+     */
+    uint64_t scan_entries(std::vector<Entry>* entries) const
+    {
+        uint64_t total = 0;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(config.directory, ec), end;
+             !ec && it != end; it.increment(ec)) {
+            if (it->path().extension() != ".gyc")
+                continue;
+            std::error_code fec;
+            const uint64_t size = it->file_size(fec);
+            const auto time = it->last_write_time(fec);
+            if (fec)
+                continue;
+            if (entries)
+                entries->push_back({time, size, it->path()});
+            total += size;
+        }
+        return total;
+    }
+
+    /**
+     * Parse an entry file of file_size bytes. Every count is checked
+     * against the bytes left before anything is allocated.
+     */
+    static bool read_entry(const std::filesystem::path& path,
+                           uint64_t file_size,
+                           std::vector<YieldResult>& results)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+
+        char magic[8];
+        uint64_t n_results = 0;
+        if (!in.read(magic, sizeof(magic)) ||
+            std::memcmp(magic, yield_cache_magic, sizeof(magic)) != 0 ||
+            !in.read(reinterpret_cast<char*>(&n_results), sizeof(n_results)))
+            return false;
+
+        if (file_size < sizeof(magic) + sizeof(n_results))
+            return false;
+        uint64_t remaining = file_size - sizeof(magic) - sizeof(n_results);
+        if (n_results > remaining / sizeof(uint64_t))
+            return false;
+
+        results.resize(n_results);
+        for (auto& r : results) {
+            uint64_t n = 0;
+            if (remaining < sizeof(n) ||
+                !in.read(reinterpret_cast<char*>(&n), sizeof(n)))
+                return false;
+            remaining -= sizeof(n);
+
+            if (n > remaining / (2 * sizeof(double)))
+                return false;
+            remaining -= 2 * n * sizeof(double);
+
+            r.yield.resize(n);
+            r.error.resize(n);
+            if (!in.read(reinterpret_cast<char*>(r.yield.data()), n * sizeof(double)) ||
+                !in.read(reinterpret_cast<char*>(r.error.data()), n * sizeof(double)))
+                return false;
+        }
+
+        return remaining == 0;
+    }
+};
+
+// ------------------------------------------------------------
+// Cached extraction
+// ------------------------------------------------------------
+
+/**
+ * Hash of a Histogram2D: dimensions, axis ranges and contents.
+ */
+inline ContentHash hash_histogram(const Histogram2D& h)
+{
+    ContentHash hash;
+    const int32_t dims[2] = {h.n_tof, h.n_energy};
+    const double axes[4] = {h.tof_min, h.tof_max, h.energy_min, h.energy_max};
+    hash.update(dims, sizeof(dims));
+    hash.update(axes, sizeof(axes));
+    hash.update(h.contents.data(), h.contents.size() * sizeof(double));
+    return hash;
+}
+
+/**
+ * Cache key of an extraction: the matrix hash (contents and axes,
+ * e.g. from hash_histogram) plus method tag and windows.
+ */
+inline std::string yield_cache_key(ContentHash hash,
+                                   const std::vector<YieldWindows>& lines,
+                                   const std::string& method = "sideband")
+{
+    hash.update_string(method);
+    hash_windows(hash, lines);
+    return hash.hex();
+}
+
+/**
+ * Return the cached results for key, or compute them with
+ * extract() and store them.
+ */
+template <typename Extract>
+std::vector<YieldResult> cached_yields(YieldCache& cache,
+                                       const std::string& key,
+                                       Extract extract)
+{
+    std::vector<YieldResult> results;
+    if (cache.load(key, results))
+        return results;
+
+    results = extract();
+    cache.store(key, results);
+    return results;
+}
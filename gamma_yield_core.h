@@ -0,0 +1,1126 @@
+/**
+ *  gamma_yield_core.h
+ *
+ *  ROOT-independent part of the gamma-ray yield extraction:
+ *  kinematics, cumulative window sums, side-band subtraction
+ *  and window optimization. Shared by the single-file analysis
+ *  (root_gamma_yield_analysis.cpp) and the batch driver
+ *  (root_gamma_yield_batch.cpp).
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+// ------------------------------------------------------------
+// Physical constants
+// ------------------------------------------------------------
+namespace constants {
+    constexpr double c_light      = 0.299792458;   // m/ns
+    constexpr double neutron_mass = 1.674927471e-27; // kg
+    constexpr double joule_to_MeV = 1.0 / 1.602176634e-13;
+    constexpr double flight_path  = 99.6755;        // m
+
+    // Derived, folded at compile time
+    constexpr double neutron_mass_MeV =
+        neutron_mass * (c_light * 1e9) * (c_light * 1e9) * joule_to_MeV;
+    constexpr double light_tof_ns = flight_path / c_light;  // gamma flash
+}
+
+// ------------------------------------------------------------
+// Utility functions
+// ------------------------------------------------------------
+
+/**
+ * Convert neutron TOF (ns) to kinetic energy (MeV)
+ * using relativistic kinematics.
+ */
+inline double tof_ns_to_energy_MeV(double tof_ns)
+{
+    const double time_s = tof_ns * 1e-9;
+    const double velocity = constants::flight_path / time_s;
+    const double beta = velocity / 299792458.0;
+
+    const double gamma =
+        1.0 / std::sqrt(1.0 - beta * beta);
+
+    const double energy_J =
+        constants::neutron_mass *
+        std::pow(299792458.0, 2) * (gamma - 1.0);
+
+    return energy_J * constants::joule_to_MeV;
+}
+
+/**
+ * Batch TOF (ns) -> neutron kinetic energy (MeV) over n values.
+ *
+ * With beta = t_light / t and s = sqrt(1 - beta^2), the kinetic
+ * energy is m c^2 (gamma - 1) = m c^2 beta^2 / (s (1 + s)), which
+ * avoids the cancellation in gamma - 1 at low beta. The loop has
+ * no branches or calls besides sqrt and vectorizes when compiled
+ * with -O3 -fno-math-errno. TOF at or below the light travel time
+ * gives NaN.
+ */
+inline void tof_ns_to_energy_MeV(
+    const double* tof_ns, double* energy_MeV, size_t n,
+    double flight_path = constants::flight_path)
+{
+    const double t_light = flight_path / constants::c_light;
+    const double mc2 = constants::neutron_mass_MeV;
+
+    for (size_t i = 0; i < n; ++i) {
+        const double beta  = t_light / tof_ns[i];
+        const double beta2 = beta * beta;
+        const double s     = std::sqrt(1.0 - beta2);
+        energy_MeV[i] = mc2 * beta2 / (s * (1.0 + s));
+    }
+}
+
+inline std::vector<double> tof_ns_to_energy_MeV(
+    const std::vector<double>& tof_ns,
+    double flight_path = constants::flight_path)
+{
+    std::vector<double> energy_MeV(tof_ns.size());
+    tof_ns_to_energy_MeV(tof_ns.data(), energy_MeV.data(),
+                         tof_ns.size(), flight_path);
+    return energy_MeV;
+}
+
+/**
+ * Batch neutron kinetic energy (MeV) -> TOF (ns), the inverse of
+ * the above: t = t_light (E + m c^2) / sqrt(E (E + 2 m c^2)).
+ */
+inline void energy_MeV_to_tof_ns(
+    const double* energy_MeV, double* tof_ns, size_t n,
+    double flight_path = constants::flight_path)
+{
+    const double t_light = flight_path / constants::c_light;
+    const double mc2 = constants::neutron_mass_MeV;
+
+    for (size_t i = 0; i < n; ++i) {
+        const double e = energy_MeV[i];
+        tof_ns[i] = t_light * (e + mc2) / std::sqrt(e * (e + 2.0 * mc2));
+    }
+}
+
+inline std::vector<double> energy_MeV_to_tof_ns(
+    const std::vector<double>& energy_MeV,
+    double flight_path = constants::flight_path)
+{
+    std::vector<double> tof_ns(energy_MeV.size());
+    energy_MeV_to_tof_ns(energy_MeV.data(), tof_ns.data(),
+                         energy_MeV.size(), flight_path);
+    return tof_ns;
+}
+
+/**
+ * Run func(i) for i in [0, n_tasks) on a small pool of worker
+ * threads. Tasks are handed out dynamically, so uneven task
+ * costs are balanced. n_threads = 0 uses all hardware threads.
+ */
+template <typename Func>
+void parallel_for(size_t n_tasks, Func func, unsigned n_threads = 0)
+{
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = static_cast<unsigned>(
+        std::min<size_t>(n_threads, n_tasks));
+
+    if (n_threads <= 1) {
+        for (size_t i = 0; i < n_tasks; ++i)
+            func(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < n_tasks; i = next++)
+            func(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < n_threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+
+    for (auto& th : pool)
+        th.join();
+}
+
+/**
+ * In-place inverse of an n x n matrix (n <= 4, row-major) by
+ * Gauss-Jordan elimination with partial pivoting.
+ * Returns false for a singular matrix.
+ */
+inline bool invert_small(int n, double* m)
+{
+    double inv[16] = {};
+    for (int i = 0; i < n; ++i)
+        inv[i * n + i] = 1.0;
+
+    for (int c = 0; c < n; ++c) {
+        int piv = c;
+        for (int r = c + 1; r < n; ++r)
+            if (std::abs(m[r * n + c]) > std::abs(m[piv * n + c]))
+                piv = r;
+        if (std::abs(m[piv * n + c]) < 1e-300)
+            return false;
+
+        if (piv != c)
+            for (int k = 0; k < n; ++k) {
+                std::swap(m[c * n + k], m[piv * n + k]);
+                std::swap(inv[c * n + k], inv[piv * n + k]);
+            }
+
+        const double d = 1.0 / m[c * n + c];
+        for (int k = 0; k < n; ++k) {
+            m[c * n + k] *= d;
+            inv[c * n + k] *= d;
+        }
+
+        for (int r = 0; r < n; ++r) {
+            if (r == c)
+                continue;
+            const double f = m[r * n + c];
+            if (f == 0.0)
+                continue;
+            for (int k = 0; k < n; ++k) {
+                m[r * n + k] -= f * m[c * n + k];
+                inv[r * n + k] -= f * inv[c * n + k];
+            }
+        }
+    }
+
+    std::copy(inv, inv + n * n, m);
+    return true;
+}
+
+/**
+ * SplitMix64 finalizer: a fast, well-mixed 64-bit hash, used for
+ * counter-based random numbers and content hashing.
+ */
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// ------------------------------------------------------------
+// Yield extraction
+// ------------------------------------------------------------
+
+struct YieldResult {
+    std::vector<double> yield;
+    std::vector<double> error;
+};
+
+/**
+ * Cumulative sums of h_time_energy along the energy axis,
+ * one row per TOF bin, accumulated in double precision.
+ *
+ * Row ib holds n_energy + 3 entries: cumsum[0] = 0 and
+ * cumsum[k + 1] = sum of energy bins 0..k (underflow and
+ * overflow included), so any energy-window integral in a
+ * TOF bin is the difference of two entries.
+ */
+struct WindowSumTable {
+    int n_tof    = 0;
+    int n_energy = 0;
+    std::vector<double> cumsum;
+
+    /**
+     * Integral over energy bins [bin_min, bin_max] (ROOT numbering,
+     * inclusive) in TOF bin ib (1-based). Out-of-range limits are
+     * clamped to the under/overflow bins, as in TH2F::Integral.
+     */
+    double integral(int ib, int bin_min, int bin_max) const
+    {
+        bin_min = std::max(bin_min, 0);
+        bin_max = std::min(bin_max, n_energy + 1);
+        if (ib < 1 || ib > n_tof || bin_max < bin_min)
+            return 0.0;
+
+        const double* row =
+            &cumsum[static_cast<size_t>(ib - 1) * (n_energy + 3)];
+        return row[bin_max + 1] - row[bin_min];
+    }
+};
+
+/**
+ * Energy-window definition (bin indices) for one gamma-ray line.
+ */
+struct YieldWindows {
+    std::string name;
+    int peak_min, peak_max;
+    int bkgL_min, bkgL_max;
+    int bkgR_min, bkgR_max;
+};
+
+/**
+ * Side-band subtraction for TOF bins [ib_begin, ib_end] (1-based,
+ * inclusive) of a single line. Writes into preallocated result.
+ */
+inline void extract_yield_bins(
+    const WindowSumTable& table,
+    const YieldWindows& w,
+    int ib_begin, int ib_end,
+    YieldResult& result
+)
+{
+    const double peak_width = w.peak_max - w.peak_min;
+    const double bkgL_width = w.bkgL_max - w.bkgL_min;
+    const double bkgR_width = w.bkgR_max - w.bkgR_min;
+
+    const double scaleL = 0.5 * peak_width / bkgL_width;
+    const double scaleR = 0.5 * peak_width / bkgR_width;
+
+    for (int ib = ib_begin; ib <= ib_end; ++ib) {
+
+        const double gross = table.integral(ib, w.peak_min, w.peak_max);
+        const double bkgL  = table.integral(ib, w.bkgL_min, w.bkgL_max);
+        const double bkgR  = table.integral(ib, w.bkgR_min, w.bkgR_max);
+
+        const double net = gross - scaleL * bkgL - scaleR * bkgR;
+
+        const double err =
+            std::sqrt(
+                gross +
+                scaleL * scaleL * bkgL +
+                scaleR * scaleR * bkgR
+            );
+
+        result.yield[ib - 1] = net;
+        result.error[ib - 1] = err;
+    }
+}
+
+/**
+ * Extract net gamma-ray yield per TOF bin using
+ * left/right side-band background subtraction.
+ */
+inline YieldResult extract_yield(
+    const WindowSumTable& table,
+    int peak_min, int peak_max,
+    int bkgL_min, int bkgL_max,
+    int bkgR_min, int bkgR_max
+)
+{
+    const YieldWindows windows{
+        "", peak_min, peak_max, bkgL_min, bkgL_max, bkgR_min, bkgR_max
+    };
+
+    YieldResult result;
+    result.yield.resize(table.n_tof, 0.0);
+    result.error.resize(table.n_tof, 0.0);
+
+    extract_yield_bins(table, windows, 1, table.n_tof, result);
+    return result;
+}
+
+/**
+ * Extract yields for several gamma-ray lines from the same matrix.
+ * The histogram is traversed once (to build the sum table); the
+ * (line, TOF chunk) work items are then processed in parallel.
+ * Results are returned in the order of the window list.
+ */
+inline std::vector<YieldResult> extract_yields(
+    const WindowSumTable& table,
+    const std::vector<YieldWindows>& lines,
+    unsigned n_threads = 0
+)
+{
+    constexpr int chunk = 256;   // TOF bins per work item
+
+    std::vector<YieldResult> results(lines.size());
+    for (auto& r : results) {
+        r.yield.resize(table.n_tof, 0.0);
+        r.error.resize(table.n_tof, 0.0);
+    }
+
+    const size_t n_chunks = (table.n_tof + chunk - 1) / chunk;
+
+    parallel_for(lines.size() * n_chunks, [&](size_t task) {
+        const size_t line = task / n_chunks;
+        const int ib_begin = 1 + static_cast<int>(task % n_chunks) * chunk;
+        const int ib_end   = std::min(ib_begin + chunk - 1, table.n_tof);
+        extract_yield_bins(table, lines[line], ib_begin, ib_end,
+                           results[line]);
+    }, n_threads);
+
+    return results;
+}
+
+// ------------------------------------------------------------
+// Window optimization
+// ------------------------------------------------------------
+
+/**
+ * Candidate grid for the window scan (energy bin indices).
+ * Side-bands are placed symmetrically around the peak:
+ *   bkgL = [peak_min - gap - width, peak_min - gap]
+ *   bkgR = [peak_max + gap, peak_max + gap + width]
+ * The gap must be at least 1 so the side-bands do not share a bin
+ * with the peak; smaller gaps in the grid are skipped. The
+ * hand-picked windows in main() correspond to peak 300-360,
+ * gap 20, width 40.
+ */
+struct WindowScanConfig {
+    int peak_min_lo, peak_min_hi;
+    int peak_max_lo, peak_max_hi;
+    int bkg_width_lo, bkg_width_hi;
+    int bkg_gap_lo, bkg_gap_hi;
+    int step = 1;
+
+    // TOF bins used for scoring (1-based, inclusive; 0 = last bin)
+    int tof_min = 1;
+    int tof_max = 0;
+};
+
+struct WindowScanResult {
+    YieldWindows windows;
+    double net          = 0.0;  // summed net yield over TOF range
+    double error        = 0.0;  // its statistical uncertainty
+    double bkg_chi2_ndf = 0.0;  // side-band deviation from a straight line
+    double score        = 0.0;  // lower is better
+};
+
+/**
+ * Evaluate one candidate over the TOF range.
+ *
+ * The score is the relative uncertainty of the summed net yield,
+ * inflated by sqrt(chi2/ndf) when that exceeds one. The side-band
+ * average is exact for any linear background, so the test is of
+ * linearity, not flatness: each side-band is split into an inner
+ * and an outer half, and a straight line is fitted to the four
+ * densities (2 degrees of freedom per TOF bin). Curvature, or peak
+ * tails leaking into the inner halves, raises chi2/ndf. TOF bins
+ * with an empty half are skipped.
+ */
+inline WindowScanResult score_windows(
+    const WindowSumTable& table,
+    const YieldWindows& w,
+    int tof_min, int tof_max
+)
+{
+    const double peak_width = w.peak_max - w.peak_min;
+    const double bkgL_width = w.bkgL_max - w.bkgL_min;
+    const double bkgR_width = w.bkgR_max - w.bkgR_min;
+
+    const double scaleL = 0.5 * peak_width / bkgL_width;
+    const double scaleR = 0.5 * peak_width / bkgR_width;
+
+    // Side-band halves: bins [lo, hi] inclusive, centre x (bins)
+    struct Half { int lo, hi; double n_bins, x; };
+    auto split = [](int lo, int hi, Half* out) {
+        const int mid = lo + (hi - lo + 1) / 2 - 1;
+        out[0] = {lo, mid, double(mid - lo + 1), 0.5 * (lo + mid)};
+        out[1] = {mid + 1, hi, double(hi - mid), 0.5 * (mid + 1 + hi)};
+    };
+    Half halves[4];
+    split(w.bkgL_min, w.bkgL_max, halves);
+    split(w.bkgR_min, w.bkgR_max, halves + 2);
+
+    double net = 0.0, var = 0.0, chi2 = 0.0;
+    int ndf = 0;
+
+    for (int ib = tof_min; ib <= tof_max; ++ib) {
+        const double gross = table.integral(ib, w.peak_min, w.peak_max);
+        const double bkgL  = table.integral(ib, w.bkgL_min, w.bkgL_max);
+        const double bkgR  = table.integral(ib, w.bkgR_min, w.bkgR_max);
+
+        net += gross - scaleL * bkgL - scaleR * bkgR;
+        var += gross + scaleL * scaleL * bkgL + scaleR * scaleR * bkgR;
+
+        // Weighted straight-line fit to the four half densities
+        double d[4], wt[4];
+        bool filled = true;
+        for (int k = 0; k < 4; ++k) {
+            const double counts = table.integral(ib, halves[k].lo, halves[k].hi);
+            filled = filled && counts > 0.0;
+            d[k]  = counts / halves[k].n_bins;
+            wt[k] = halves[k].n_bins * halves[k].n_bins / counts;
+        }
+        if (!filled)
+            continue;
+
+        double S = 0.0, Sx = 0.0, Sxx = 0.0, Sy = 0.0, Sxy = 0.0;
+        for (int k = 0; k < 4; ++k) {
+            const double x = halves[k].x;
+            S   += wt[k];
+            Sx  += wt[k] * x;
+            Sxx += wt[k] * x * x;
+            Sy  += wt[k] * d[k];
+            Sxy += wt[k] * x * d[k];
+        }
+        const double det   = S * Sxx - Sx * Sx;
+        const double slope = (S * Sxy - Sx * Sy) / det;
+        const double icpt  = (Sy - slope * Sx) / S;
+        for (int k = 0; k < 4; ++k) {
+            const double r = d[k] - icpt - slope * halves[k].x;
+            chi2 += wt[k] * r * r;
+        }
+        ndf += 2;
+    }
+
+    WindowScanResult r;
+    r.windows      = w;
+    r.net          = net;
+    r.error        = std::sqrt(var);
+    r.bkg_chi2_ndf = ndf > 0 ? chi2 / ndf : 0.0;
+
+    const double rel_error =
+        net > 0.0 ? r.error / net : std::numeric_limits<double>::infinity();
+    r.score = rel_error * std::sqrt(std::max(1.0, r.bkg_chi2_ndf));
+
+    return r;
+}
+
+/**
+ * Scan all peak/side-band combinations of the grid in parallel.
+ * Candidates whose windows fall outside the energy axis are skipped.
+ * Returns the evaluated candidates sorted by score (best first).
+ */
+inline std::vector<WindowScanResult> scan_windows(
+    const WindowSumTable& table,
+    const WindowScanConfig& cfg,
+    unsigned n_threads = 0
+)
+{
+    const int step = std::max(cfg.step, 1);
+    const int tof_max = cfg.tof_max > 0 ? std::min(cfg.tof_max, table.n_tof)
+                                        : table.n_tof;
+    const int tof_min = std::max(cfg.tof_min, 1);
+
+    std::vector<YieldWindows> candidates;
+    for (int pmin = cfg.peak_min_lo; pmin <= cfg.peak_min_hi; pmin += step)
+    for (int pmax = cfg.peak_max_lo; pmax <= cfg.peak_max_hi; pmax += step)
+    for (int wid = cfg.bkg_width_lo; wid <= cfg.bkg_width_hi; wid += step)
+    for (int gap = cfg.bkg_gap_lo; gap <= cfg.bkg_gap_hi; gap += step) {
+
+        if (pmax <= pmin || wid < 1 || gap < 1)
+            continue;
+
+        YieldWindows w{
+            "",
+            pmin, pmax,
+            pmin - gap - wid, pmin - gap,
+            pmax + gap, pmax + gap + wid
+        };
+        if (w.bkgL_min < 1 || w.bkgR_max > table.n_energy)
+            continue;
+
+        candidates.push_back(w);
+    }
+
+    std::vector<WindowScanResult> results(candidates.size());
+    parallel_for(candidates.size(), [&](size_t i) {
+        results[i] = score_windows(table, candidates[i], tof_min, tof_max);
+    }, n_threads);
+
+    std::sort(results.begin(), results.end(),
+              [](const WindowScanResult& a, const WindowScanResult& b) {
+                  return a.score < b.score;
+              });
+
+    return results;
+}
+
+// ------------------------------------------------------------
+// Neutron-energy binning
+// ------------------------------------------------------------
+
+/**
+ * Equal-lethargy (logarithmic) energy bin edges between
+ * e_min and e_max (MeV), with bins_per_decade bins per decade.
+ * The last bin ends exactly at e_max and may be narrower.
+ */
+inline std::vector<double> equal_lethargy_edges(
+    double e_min, double e_max, int bins_per_decade)
+{
+    const double decades = std::log10(e_max / e_min);
+    const int n_bins =
+        std::max(1, static_cast<int>(std::ceil(decades * bins_per_decade - 1e-9)));
+
+    std::vector<double> edges(n_bins + 1);
+    for (int i = 0; i < n_bins; ++i)
+        edges[i] = e_min * std::pow(10.0, double(i) / bins_per_decade);
+    edges[n_bins] = e_max;
+
+    return edges;
+}
+
+/**
+ * Assignment of TOF bins to neutron-energy bins.
+ * energy_bin[i] is the (0-based) energy bin receiving TOF bin i,
+ * or -1 when the bin centre lies outside the energy range
+ * (including unphysical TOF below the speed of light).
+ */
+struct TofEnergyBinMap {
+    std::vector<double> energy_edges;   // MeV, increasing
+    std::vector<int> energy_bin;
+};
+
+/**
+ * Precompute the TOF-to-energy bin map from TOF bin edges (ns)
+ * and energy bin edges (MeV). Each TOF bin is assigned whole to
+ * the energy bin containing the energy of its centre, so merged
+ * yields stay statistically independent between energy bins.
+ */
+inline TofEnergyBinMap build_tof_energy_map(
+    const std::vector<double>& tof_edges,
+    const std::vector<double>& energy_edges)
+{
+    const size_t n_tof = tof_edges.size() - 1;
+
+    TofEnergyBinMap map;
+    map.energy_edges = energy_edges;
+    map.energy_bin.assign(n_tof, -1);
+
+    std::vector<double> tof_centre(n_tof);
+    for (size_t i = 0; i < n_tof; ++i)
+        tof_centre[i] = 0.5 * (tof_edges[i] + tof_edges[i + 1]);
+    const std::vector<double> centre_energy = tof_ns_to_energy_MeV(tof_centre);
+
+    for (size_t i = 0; i < n_tof; ++i) {
+        const double energy = centre_energy[i];
+
+        if (!std::isfinite(energy) || energy < energy_edges.front() ||
+            energy >= energy_edges.back())
+            continue;
+
+        const auto it = std::upper_bound(
+            energy_edges.begin(), energy_edges.end(), energy);
+        map.energy_bin[i] = static_cast<int>(it - energy_edges.begin()) - 1;
+    }
+
+    return map;
+}
+
+/**
+ * Merge a per-TOF-bin yield into neutron-energy bins.
+ * Yields add; errors add in quadrature (TOF bins are independent).
+ */
+inline YieldResult rebin_yield_to_energy(
+    const YieldResult& tof_yield,
+    const TofEnergyBinMap& map)
+{
+    const size_t n_energy = map.energy_edges.size() - 1;
+
+    YieldResult result;
+    result.yield.assign(n_energy, 0.0);
+    result.error.assign(n_energy, 0.0);
+
+    for (size_t i = 0; i < tof_yield.yield.size(); ++i) {
+        const int ie = map.energy_bin[i];
+        if (ie < 0)
+            continue;
+        result.yield[ie] += tof_yield.yield[i];
+        result.error[ie] += tof_yield.error[i] * tof_yield.error[i];
+    }
+
+    for (double& e : result.error)
+        e = std::sqrt(e);
+
+    return result;
+}
+
+// ------------------------------------------------------------
+// Adaptive TOF rebinning
+// ------------------------------------------------------------
+
+struct AdaptiveBinning {
+    // Merged bin k covers TOF bins [first_bin[k], first_bin[k + 1])
+    // (0-based); the last entry is the total number of TOF bins.
+    std::vector<int> first_bin;
+    YieldResult yield;
+};
+
+/**
+ * Greedily merge consecutive TOF bins (from low to high TOF) until
+ * each merged bin reaches a relative uncertainty <= target_rel_error,
+ * using the side-band error model of extract_yield (net yields add,
+ * variances add). A trailing group that never reaches the target is
+ * merged into the previous bin. Linear in the number of TOF bins:
+ * group totals come from prefix sums of net yield and variance.
+ */
+inline AdaptiveBinning adaptive_rebin(
+    const YieldResult& tof_yield,
+    double target_rel_error)
+{
+    const size_t n = tof_yield.yield.size();
+
+    std::vector<double> cum_net(n + 1, 0.0), cum_var(n + 1, 0.0);
+    for (size_t i = 0; i < n; ++i) {
+        cum_net[i + 1] = cum_net[i] + tof_yield.yield[i];
+        cum_var[i + 1] = cum_var[i] + tof_yield.error[i] * tof_yield.error[i];
+    }
+
+    AdaptiveBinning out;
+    out.first_bin.push_back(0);
+
+    size_t start = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const double net = cum_net[i + 1] - cum_net[start];
+        const double var = cum_var[i + 1] - cum_var[start];
+
+        if (net > 0.0 && std::sqrt(var) <= target_rel_error * net) {
+            out.first_bin.push_back(static_cast<int>(i + 1));
+            start = i + 1;
+        }
+    }
+
+    if (start < n) {
+        if (out.first_bin.size() > 1)
+            out.first_bin.back() = static_cast<int>(n);
+        else
+            out.first_bin.push_back(static_cast<int>(n));
+    }
+
+    const size_t n_merged = out.first_bin.size() - 1;
+    out.yield.yield.resize(n_merged);
+    out.yield.error.resize(n_merged);
+    for (size_t k = 0; k < n_merged; ++k) {
+        const int a = out.first_bin[k], b = out.first_bin[k + 1];
+        out.yield.yield[k] = cum_net[b] - cum_net[a];
+        out.yield.error[k] = std::sqrt(cum_var[b] - cum_var[a]);
+    }
+
+    return out;
+}
+
+// ------------------------------------------------------------
+// Polynomial side-band background
+// ------------------------------------------------------------
+
+/**
+ * Cumulative energy moments sum_k x_k^m y_k (m = 0..2 * order) per
+ * TOF bin over an energy-bin range [first_bin, last_bin], with the
+ * local coordinate x = (bin - origin) / scale. These are the sums
+ * entering the normal equations of a polynomial fit of the given
+ * order and its covariance, so any window costs O(order^2).
+ */
+struct MomentSumTable {
+    int n_tof     = 0;
+    int first_bin = 0;
+    int last_bin  = 0;
+    int order     = 1;
+    double origin = 0.0;
+    double scale  = 1.0;
+
+    // Layout: [TOF bin][bin - first_bin + 1][moment], with a leading
+    // zero row per TOF bin
+    std::vector<double> cumsum;
+
+    int n_moments() const { return 2 * order + 1; }
+
+    double x_of(int bin) const { return (bin - origin) / scale; }
+
+    /**
+     * Moments of energy bins [bin_min, bin_max] (inside the table
+     * range) in TOF bin ib (1-based); writes n_moments() values.
+     */
+    void window_moments(int ib, int bin_min, int bin_max, double* m) const
+    {
+        const int nm = n_moments();
+        const size_t row = static_cast<size_t>(last_bin - first_bin + 2) * nm;
+        const double* base = &cumsum[(ib - 1) * row];
+        const double* hi = base + (bin_max - first_bin + 1) * nm;
+        const double* lo = base + (bin_min - first_bin) * nm;
+        for (int k = 0; k < nm; ++k)
+            m[k] = hi[k] - lo[k];
+    }
+};
+
+/**
+ * Net yield per TOF bin with a polynomial (order 0..2) background
+ * fitted to both side-bands by ordinary least squares.
+ *
+ * With G = X^T X and P = sum over peak bins of (1, x, x^2), the
+ * background under the peak is v . Y with v = G^-1 P and
+ * Y = X^T y, and its variance v^T (X^T diag(y) X) v, i.e. the full
+ * coefficient covariance projected onto the peak window. G and v
+ * depend only on the windows and are computed once.
+ *
+ * Windows count bins inclusively here (max - min + 1 bins), as a fit
+ * over bins must, while extract_yield keeps its original max - min
+ * widths and averages the two side-band densities with equal weight.
+ * Order 0 is therefore not identical to extract_yield: it scales the
+ * pooled side-band sum by (peak bins) / (side-band bins). Compare
+ * orders 0, 1, 2 with each other to judge the background curvature,
+ * not against extract_yield.
+ *
+ * The fit needs at least order + 1 side-band bins in total (left
+ * and right together): 1 for order 0, 2 for order 1, 3 for order 2,
+ * and in practice several more for a meaningful background error.
+ * Fewer bins, or otherwise singular normal equations, throw
+ * std::invalid_argument rather than returning zero yields.
+ */
+inline YieldResult extract_yield_poly(
+    const MomentSumTable& table,
+    const YieldWindows& w,
+    unsigned n_threads = 0
+)
+{
+    const int p  = table.order + 1;   // number of coefficients
+    const int nm = table.n_moments();
+
+    // Geometric sums of x^m over the side-bands and the peak
+    std::vector<double> sb_pow(nm, 0.0), peak_pow(p, 0.0);
+    auto add_powers = [&](int lo, int hi, std::vector<double>& out) {
+        for (int bin = lo; bin <= hi; ++bin) {
+            double xm = 1.0;
+            const double x = table.x_of(bin);
+            for (double& o : out) {
+                o += xm;
+                xm *= x;
+            }
+        }
+    };
+    add_powers(w.bkgL_min, w.bkgL_max, sb_pow);
+    add_powers(w.bkgR_min, w.bkgR_max, sb_pow);
+    add_powers(w.peak_min, w.peak_max, peak_pow);
+
+    double G[16];
+    for (int i = 0; i < p; ++i)
+        for (int j = 0; j < p; ++j)
+            G[i * p + j] = sb_pow[i + j];
+
+    const int n_sideband_bins =
+        std::max(w.bkgL_max - w.bkgL_min + 1, 0) +
+        std::max(w.bkgR_max - w.bkgR_min + 1, 0);
+    if (n_sideband_bins < p || !invert_small(p, G))
+        throw std::invalid_argument(
+            "extract_yield_poly: order " + std::to_string(table.order)
+            + " background cannot be fitted to " + std::to_string(n_sideband_bins)
+            + " side-band bins (need at least " + std::to_string(p) + ")");
+
+    YieldResult result;
+    result.yield.assign(table.n_tof, 0.0);
+    result.error.assign(table.n_tof, 0.0);
+
+    double v[3] = {};
+    for (int i = 0; i < p; ++i)
+        for (int j = 0; j < p; ++j)
+            v[i] += G[i * p + j] * peak_pow[j];
+
+    constexpr int chunk = 256;
+    const size_t n_chunks = (table.n_tof + chunk - 1) / chunk;
+
+    parallel_for(n_chunks, [&](size_t c) {
+        const int ib_begin = 1 + static_cast<int>(c) * chunk;
+        const int ib_end   = std::min(ib_begin + chunk - 1, table.n_tof);
+
+        double mL[5], mR[5], mP[5];
+        for (int ib = ib_begin; ib <= ib_end; ++ib) {
+            table.window_moments(ib, w.bkgL_min, w.bkgL_max, mL);
+            table.window_moments(ib, w.bkgR_min, w.bkgR_max, mR);
+            table.window_moments(ib, w.peak_min, w.peak_max, mP);
+
+            double bkg = 0.0, bkg_var = 0.0;
+            for (int i = 0; i < p; ++i) {
+                bkg += v[i] * (mL[i] + mR[i]);
+                for (int j = 0; j < p; ++j)
+                    bkg_var += v[i] * v[j] * (mL[i + j] + mR[i + j]);
+            }
+
+            const double gross = mP[0];
+            result.yield[ib - 1] = gross - bkg;
+            result.error[ib - 1] = std::sqrt(gross + bkg_var);
+        }
+    }, n_threads);
+
+    return result;
+}
+
+// ------------------------------------------------------------
+// Incremental (online) extraction
+// ------------------------------------------------------------
+
+/**
+ * Running side-band extraction for online monitoring. Holds the
+ * peak and side-band sums per TOF bin; new counts update only the
+ * accumulators they fall into, and refresh() recomputes only the
+ * TOF bins touched since the last refresh. The peak and side-band
+ * windows must not overlap.
+ */
+struct IncrementalYield {
+    YieldWindows windows{};
+    int n_tof = 0;
+
+    std::vector<double> gross, bkgL, bkgR;
+    YieldResult current;
+
+    // 0 = outside, 1 = peak, 2 = left, 3 = right; per energy bin
+    // (ROOT numbering, under/overflow included)
+    std::vector<unsigned char> region_of_bin;
+
+    std::vector<int> dirty_bins;            // 1-based TOF bins
+    std::vector<unsigned char> is_dirty;
+
+    /**
+     * Set up empty accumulators for windows w. Every energy bin must
+     * belong to at most one window (after clamping to the axis), so
+     * overlapping windows or windows sharing a boundary bin, which
+     * extract_yield would accept, are rejected: returns false and
+     * leaves the object empty.
+     */
+    bool reset(int n_tof_bins, int n_energy_bins, const YieldWindows& w)
+    {
+        windows = w;
+        n_tof   = n_tof_bins;
+
+        gross.assign(n_tof, 0.0);
+        bkgL.assign(n_tof, 0.0);
+        bkgR.assign(n_tof, 0.0);
+        current.yield.assign(n_tof, 0.0);
+        current.error.assign(n_tof, 0.0);
+        dirty_bins.clear();
+        is_dirty.assign(n_tof, 0);
+
+        region_of_bin.assign(n_energy_bins + 2, 0);
+        auto mark = [&](int lo, int hi, unsigned char region) {
+            for (int b = std::max(lo, 0);
+                 b <= std::min(hi, n_energy_bins + 1); ++b) {
+                if (region_of_bin[b] != 0)
+                    return false;
+                region_of_bin[b] = region;
+            }
+            return true;
+        };
+        if (!mark(w.bkgL_min, w.bkgL_max, 2) ||
+            !mark(w.bkgR_min, w.bkgR_max, 3) ||
+            !mark(w.peak_min, w.peak_max, 1)) {
+            *this = IncrementalYield{};
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Overwrite the window sums of TOF bin ib (1-based), e.g. to
+     * seed the accumulators from an existing matrix.
+     */
+    void set_sums(int ib, double gross_sum, double bkgL_sum, double bkgR_sum)
+    {
+        if (ib < 1 || ib > n_tof)
+            return;
+
+        gross[ib - 1] = gross_sum;
+        bkgL[ib - 1]  = bkgL_sum;
+        bkgR[ib - 1]  = bkgR_sum;
+
+        if (!is_dirty[ib - 1]) {
+            is_dirty[ib - 1] = 1;
+            dirty_bins.push_back(ib);
+        }
+    }
+
+    /**
+     * Add counts to TOF bin ib (1-based), energy bin ie (ROOT
+     * numbering). O(1).
+     */
+    void add(int ib, int ie, double counts = 1.0)
+    {
+        if (ib < 1 || ib > n_tof || ie < 0 ||
+            ie >= static_cast<int>(region_of_bin.size()))
+            return;
+
+        switch (region_of_bin[ie]) {
+            case 1: gross[ib - 1] += counts; break;
+            case 2: bkgL[ib - 1]  += counts; break;
+            case 3: bkgR[ib - 1]  += counts; break;
+            default: return;
+        }
+
+        if (!is_dirty[ib - 1]) {
+            is_dirty[ib - 1] = 1;
+            dirty_bins.push_back(ib);
+        }
+    }
+
+    /**
+     * Recompute net yield and error of the TOF bins changed since the
+     * last call (same formula as extract_yield) and report each one
+     * through on_update(ib, net, error). Returns the number of bins.
+     */
+    template <typename Func>
+    size_t refresh(Func on_update)
+    {
+        const YieldWindows& w = windows;
+        const double peak_width = w.peak_max - w.peak_min;
+        const double scaleL = 0.5 * peak_width / (w.bkgL_max - w.bkgL_min);
+        const double scaleR = 0.5 * peak_width / (w.bkgR_max - w.bkgR_min);
+
+        for (int ib : dirty_bins) {
+            const size_t i = ib - 1;
+            current.yield[i] = gross[i] - scaleL * bkgL[i] - scaleR * bkgR[i];
+            current.error[i] = std::sqrt(gross[i]
+                                         + scaleL * scaleL * bkgL[i]
+                                         + scaleR * scaleR * bkgR[i]);
+            is_dirty[i] = 0;
+            on_update(ib, current.yield[i], current.error[i]);
+        }
+
+        const size_t n_updated = dirty_bins.size();
+        dirty_bins.clear();
+        return n_updated;
+    }
+
+    size_t refresh()
+    {
+        return refresh([](int, double, double) {});
+    }
+};
+
+// ------------------------------------------------------------
+// Stability across time slices
+// ------------------------------------------------------------
+
+struct StabilityResult {
+    YieldResult normalized;         // per time slice
+    double mean       = 0.0;        // weighted mean of the slices
+    double mean_error = 0.0;
+    double chi2       = 0.0;        // consistency with a constant
+    int    ndf        = 0;
+    std::vector<double> pull;       // (value - mean) / error per slice
+};
+
+/**
+ * Summed net yield over TOF bins [tof_min, tof_max] (1-based) of
+ * every time slice, divided by the slice normalization (beam
+ * monitor, live time, ...), and tested for consistency with a
+ * constant. Errors of the normalization are optional.
+ */
+inline StabilityResult check_yield_stability(
+    const std::vector<YieldResult>& slices,
+    const std::vector<double>& norm,
+    const std::vector<double>& norm_error,
+    int tof_min, int tof_max)
+{
+    const size_t n = slices.size();
+
+    StabilityResult r;
+    r.normalized.yield.assign(n, 0.0);
+    r.normalized.error.assign(n, 0.0);
+    r.pull.assign(n, 0.0);
+
+    double sw = 0.0, swx = 0.0;
+    for (size_t s = 0; s < n; ++s) {
+        const YieldResult& y = slices[s];
+        const int hi = std::min<int>(tof_max, y.yield.size());
+
+        double net = 0.0, var = 0.0;
+        for (int ib = std::max(tof_min, 1); ib <= hi; ++ib) {
+            net += y.yield[ib - 1];
+            var += y.error[ib - 1] * y.error[ib - 1];
+        }
+
+        const double nrm = norm.empty() ? 1.0 : norm[s];
+        const double rel_norm =
+            norm_error.empty() ? 0.0 : norm_error[s] / nrm;
+        const double value = net / nrm;
+        const double error =
+            std::sqrt(var / (nrm * nrm) + value * value * rel_norm * rel_norm);
+
+        r.normalized.yield[s] = value;
+        r.normalized.error[s] = error;
+
+        if (error > 0.0) {
+            sw  += 1.0 / (error * error);
+            swx += value / (error * error);
+        }
+    }
+
+    if (sw <= 0.0)
+        return r;
+
+    r.mean       = swx / sw;
+    r.mean_error = 1.0 / std::sqrt(sw);
+
+    for (size_t s = 0; s < n; ++s) {
+        const double err = r.normalized.error[s];
+        if (err <= 0.0)
+            continue;
+        r.pull[s] = (r.normalized.yield[s] - r.mean) / err;
+        r.chi2 += r.pull[s] * r.pull[s];
+        ++r.ndf;
+    }
+    r.ndf -= 1;
+
+    return r;
+}
+
+// ------------------------------------------------------------
+// Gamma-flash T0
+// ------------------------------------------------------------
+
+struct GammaFlash {
+    double tof_ns       = 0.0;      // fitted prompt-peak position
+    double t0_offset_ns = 0.0;      // tof_ns - flight_path / c
+    bool   found        = false;
+};
+
+/**
+ * Locate the gamma flash in a TOF spectrum (counts per bin, bin
+ * edges in ns) within [search_min, search_max] ns. The maximum bin
+ * is refined with a three-point Gaussian (log-parabola) fit, or a
+ * plain parabola when a neighbour is empty. The T0 offset is the
+ * shift that places the flash at the light travel time.
+ */
+inline GammaFlash find_gamma_flash(
+    const std::vector<double>& spectrum,
+    const std::vector<double>& tof_edges,
+    double search_min = -std::numeric_limits<double>::infinity(),
+    double search_max = std::numeric_limits<double>::infinity(),
+    double flight_path = constants::flight_path)
+{
+    GammaFlash flash;
+    const int n = static_cast<int>(spectrum.size());
+
+    int i_max = -1;
+    for (int i = 1; i + 1 < n; ++i) {
+        const double centre = 0.5 * (tof_edges[i] + tof_edges[i + 1]);
+        if (centre < search_min || centre > search_max)
+            continue;
+        if (i_max < 0 || spectrum[i] > spectrum[i_max])
+            i_max = i;
+    }
+    if (i_max < 0 || spectrum[i_max] <= 0.0)
+        return flash;
+
+    const double ym = spectrum[i_max - 1];
+    const double y0 = spectrum[i_max];
+    const double yp = spectrum[i_max + 1];
+
+    double delta = 0.0;
+    if (ym > 0.0 && yp > 0.0) {
+        const double lm = std::log(ym), l0 = std::log(y0), lp = std::log(yp);
+        const double curv = lm - 2.0 * l0 + lp;
+        if (curv < 0.0)
+            delta = 0.5 * (lm - lp) / curv;
+    } else {
+        const double curv = ym - 2.0 * y0 + yp;
+        if (curv < 0.0)
+            delta = 0.5 * (ym - yp) / curv;
+    }
+    delta = std::max(-0.5, std::min(0.5, delta));
+
+    const double width = tof_edges[i_max + 1] - tof_edges[i_max];
+    flash.tof_ns = 0.5 * (tof_edges[i_max] + tof_edges[i_max + 1]) + delta * width;
+    flash.t0_offset_ns = flash.tof_ns - flight_path / constants::c_light;
+    flash.found = true;
+
+    return flash;
+}
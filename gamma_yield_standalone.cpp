@@ -0,0 +1,114 @@
+/**
+ *  gamma_yield_standalone.cpp
+ *
+ *  ROOT-free side-band yield extraction for one TOF-energy matrix.
+ *  Reads the lightweight Histogram2D formats of gamma_histogram.h
+ *  or a memory-mapped tiled matrix (gamma_tiled_matrix.h) and writes
+ *  the net yield per TOF bin as CSV, so a single extraction starts
+ *  in milliseconds instead of loading ROOT.
+ *
+ *  ROOT histograms are converted once with to_histogram2d() and
+ *  write_histogram2d() (see root_gamma_yield.h).
+ *
+ *  Author: Ali F. Alwars
+ *
+ *  Compile:
+ *    g++ -std=c++17 -O2 -pthread gamma_yield_standalone.cpp \
+ *        -o gamma_yield_standalone
+ *
+ *  Usage:
+ *    ./gamma_yield_standalone matrix.gyh|matrix.npy|matrix.gyt \
+ *        peak_min peak_max bkgL_min bkgL_max bkgR_min bkgR_max [output.csv]
+ *  Window limits are energy bin numbers (ROOT numbering, 1-based).
+ *  .npy matrices have shape n_tof x n_energy; their TOF axis is in
+ *  bin units.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "gamma_yield_core.h"
+#include "gamma_histogram.h"
+#include "gamma_tiled_matrix.h"
+
+static bool has_suffix(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// ------------------------------------------------------------
+// Main
+// ------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 8) {
+        std::cerr << "Usage: " << argv[0]
+                  << " matrix.gyh|matrix.npy|matrix.gyt peak_min peak_max"
+                     " bkgL_min bkgL_max bkgR_min bkgR_max [output.csv]\n";
+        return 1;
+    }
+
+    const std::string input = argv[1];
+    int limits[6];
+    for (int i = 0; i < 6; ++i)
+        limits[i] = std::stoi(argv[i + 2]);
+    const std::string output_name =
+        argc > 8 ? argv[8] : "gamma_yield_tof.csv";
+
+    const YieldWindows windows{
+        "", limits[0], limits[1], limits[2], limits[3], limits[4], limits[5]
+    };
+
+    YieldResult yield;
+    std::vector<double> edges;
+
+    if (has_suffix(input, ".gyt")) {
+        // Out-of-core matrix, streamed band by band
+        TiledMatrix matrix;
+        if (!matrix.open(input)) {
+            std::cerr << "Error: cannot read " << input << "\n";
+            return 1;
+        }
+        yield = extract_yields(matrix, {windows}).front();
+        edges = matrix.tof_edges();
+    } else {
+        Histogram2D h_time_energy;
+        const bool ok = has_suffix(input, ".npy")
+                      ? read_npy_histogram(input, h_time_energy)
+                      : read_histogram2d(input, h_time_energy);
+        if (!ok) {
+            std::cerr << "Error: cannot read " << input << "\n";
+            return 1;
+        }
+
+        // Extract yield
+        yield = extract_yield(
+            build_window_sum_table(h_time_energy),
+            windows.peak_min, windows.peak_max,
+            windows.bkgL_min, windows.bkgL_max,
+            windows.bkgR_min, windows.bkgR_max
+        );
+        edges = h_time_energy.tof_edges();
+    }
+
+    // Write output
+    std::ofstream out(output_name);
+    if (!out) {
+        std::cerr << "Error: cannot write " << output_name << "\n";
+        return 1;
+    }
+
+    const int n_tof = static_cast<int>(yield.yield.size());
+    out << "tof_bin,tof_low_ns,tof_high_ns,yield,error\n";
+    out.precision(10);
+    for (int ib = 1; ib <= n_tof; ++ib)
+        out << ib << ',' << edges[ib - 1] << ',' << edges[ib] << ','
+            << yield.yield[ib - 1] << ',' << yield.error[ib - 1] << '\n';
+
+    std::cout << "Net yield of " << n_tof
+              << " TOF bins written to " << output_name << "\n";
+    return 0;
+}
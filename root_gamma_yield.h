@@ -0,0 +1,426 @@
+/**
+ *  root_gamma_yield.h
+ *
+ *  ROOT adapters for the yield extraction in gamma_yield_core.h:
+ *  building the window sum table from a TH2F and converting
+ *  results back into TOF histograms.
+ *
+ *  Adapters of the optional analysis stages live next to them in
+ *  root_gamma_yield_<stage>.h, so that this header depends on the
+ *  core code only.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1F.h"
+#include "TH2F.h"
+#include "TAxis.h"
+#include "TMath.h"
+
+#include "gamma_yield_core.h"
+
+// ------------------------------------------------------------
+// TH2F input
+// ------------------------------------------------------------
+
+/**
+ * Bin edges of a ROOT axis (fixed or variable binning).
+ */
+inline std::vector<double> axis_bin_edges(const TAxis* axis)
+{
+    const int n = axis->GetNbins();
+    std::vector<double> edges(n + 1);
+    for (int i = 1; i <= n; ++i)
+        edges[i - 1] = axis->GetBinLowEdge(i);
+    edges[n] = axis->GetBinUpEdge(n);
+    return edges;
+}
+
+/**
+ * Build the per-TOF-bin cumulative energy sums of h_time_energy.
+ * Costs one pass over the histogram; every later window integral
+ * is O(1).
+ */
+inline WindowSumTable build_window_sum_table(const TH2F* h_time_energy)
+{
+    WindowSumTable table;
+    table.n_tof    = h_time_energy->GetNbinsX();
+    table.n_energy = h_time_energy->GetNbinsY();
+
+    const size_t row_size = table.n_energy + 3;
+    table.cumsum.resize(row_size * table.n_tof, 0.0);
+
+    for (int ib = 1; ib <= table.n_tof; ++ib) {
+        double* row = &table.cumsum[(ib - 1) * row_size];
+        double sum = 0.0;
+        for (int ie = 0; ie <= table.n_energy + 1; ++ie) {
+            sum += h_time_energy->GetBinContent(ib, ie);
+            row[ie + 1] = sum;
+        }
+    }
+
+    return table;
+}
+
+/**
+ * Build the cumulative moment table of h_time_energy over energy
+ * bins [first_bin, last_bin] for a polynomial background of the
+ * given order (0..2), with x = (bin - origin) / scale.
+ */
+inline MomentSumTable build_moment_sum_table(
+    const TH2F* h_time_energy,
+    int first_bin, int last_bin,
+    int order, double origin, double scale
+)
+{
+    MomentSumTable table;
+    table.n_tof     = h_time_energy->GetNbinsX();
+    table.first_bin = first_bin;
+    table.last_bin  = last_bin;
+    table.order     = std::max(0, std::min(order, 2));
+    table.origin    = origin;
+    table.scale     = scale;
+
+    const int nm = table.n_moments();
+    const size_t row = static_cast<size_t>(last_bin - first_bin + 2) * nm;
+    table.cumsum.assign(row * table.n_tof, 0.0);
+
+    for (int ib = 1; ib <= table.n_tof; ++ib) {
+        double* out = &table.cumsum[(ib - 1) * row];
+        for (int bin = first_bin; bin <= last_bin; ++bin) {
+            const double y = h_time_energy->GetBinContent(ib, bin);
+            const double x = table.x_of(bin);
+            const double* prev = out + (bin - first_bin) * nm;
+            double* cur = out + (bin - first_bin + 1) * nm;
+            double xm = 1.0;
+            for (int k = 0; k < nm; ++k) {
+                cur[k] = prev[k] + xm * y;
+                xm *= x;
+            }
+        }
+    }
+
+    return table;
+}
+
+/**
+ * Polynomial side-band background for a single line: the moment
+ * table spans the two side-bands, centred on the peak and scaled
+ * to about [-1, 1] for well-conditioned normal equations. Window
+ * widths count bins inclusively, so order 0 differs slightly from
+ * extract_yield (see the core extract_yield_poly). Throws
+ * std::invalid_argument if the side-bands hold fewer than
+ * order + 1 bins.
+ */
+inline YieldResult extract_yield_poly(
+    const TH2F* h_time_energy,
+    const YieldWindows& w,
+    int order
+)
+{
+    const double origin = 0.5 * (w.peak_min + w.peak_max);
+    const double scale  = std::max(0.5 * (w.bkgR_max - w.bkgL_min), 1.0);
+
+    return extract_yield_poly(
+        build_moment_sum_table(h_time_energy, w.bkgL_min, w.bkgR_max,
+                               order, origin, scale),
+        w);
+}
+
+/**
+ * Convenience overload working directly on the TOF-energy matrix.
+ */
+inline YieldResult extract_yield(
+    const TH2F* h_time_energy,
+    int peak_min, int peak_max,
+    int bkgL_min, int bkgL_max,
+    int bkgR_min, int bkgR_max
+)
+{
+    return extract_yield(
+        build_window_sum_table(h_time_energy),
+        peak_min, peak_max,
+        bkgL_min, bkgL_max,
+        bkgR_min, bkgR_max
+    );
+}
+
+inline std::vector<YieldResult> extract_yields(
+    const TH2F* h_time_energy,
+    const std::vector<YieldWindows>& lines,
+    unsigned n_threads = 0
+)
+{
+    return extract_yields(build_window_sum_table(h_time_energy),
+                          lines, n_threads);
+}
+
+/**
+ * Contents and errors of a 1D histogram (e.g. the neutron flux)
+ * as a YieldResult, without under/overflow.
+ */
+inline YieldResult histogram_to_yield(const TH1F* h)
+{
+    const int n = h->GetNbinsX();
+    YieldResult out;
+    out.yield.resize(n);
+    out.error.resize(n);
+    for (int i = 1; i <= n; ++i) {
+        out.yield[i - 1] = h->GetBinContent(i);
+        out.error[i - 1] = h->GetBinError(i);
+    }
+    return out;
+}
+
+/**
+ * TOF-energy matrix content as a row-major n_tof x n_energy block
+ * (one row per TOF bin, no under/overflow).
+ */
+inline std::vector<double> matrix_rows(const TH2F* h_time_energy)
+{
+    const int nTOF = h_time_energy->GetNbinsX();
+    const int nE   = h_time_energy->GetNbinsY();
+
+    std::vector<double> rows(size_t(nTOF) * nE);
+    for (int ie = 1; ie <= nE; ++ie)
+        for (int ib = 1; ib <= nTOF; ++ib)
+            rows[size_t(ib - 1) * nE + (ie - 1)] =
+                h_time_energy->GetBinContent(ib, ie);
+    return rows;
+}
+
+/**
+ * TOF spectrum of h_time_energy summed over all energy bins.
+ */
+inline std::vector<double> tof_projection(const TH2F* h_time_energy)
+{
+    const int nTOF = h_time_energy->GetNbinsX();
+    const int nE   = h_time_energy->GetNbinsY();
+
+    std::vector<double> spectrum(nTOF, 0.0);
+    for (int ie = 1; ie <= nE; ++ie)
+        for (int ib = 1; ib <= nTOF; ++ib)
+            spectrum[ib - 1] += h_time_energy->GetBinContent(ib, ie);
+    return spectrum;
+}
+
+inline GammaFlash find_gamma_flash(
+    const TH2F* h_time_energy,
+    double search_min = -std::numeric_limits<double>::infinity(),
+    double search_max = std::numeric_limits<double>::infinity()
+)
+{
+    return find_gamma_flash(tof_projection(h_time_energy),
+                            axis_bin_edges(h_time_energy->GetXaxis()),
+                            search_min, search_max);
+}
+
+/**
+ * Locate the gamma flash of many runs in parallel.
+ */
+inline std::vector<GammaFlash> find_gamma_flash_runs(
+    const std::vector<const TH2F*>& runs,
+    double search_min = -std::numeric_limits<double>::infinity(),
+    double search_max = std::numeric_limits<double>::infinity(),
+    unsigned n_threads = 0
+)
+{
+    std::vector<GammaFlash> flashes(runs.size());
+    parallel_for(runs.size(), [&](size_t i) {
+        flashes[i] = find_gamma_flash(runs[i], search_min, search_max);
+    }, n_threads);
+    return flashes;
+}
+
+/**
+ * Apply a T0 correction to a histogram by shifting its TOF axis
+ * (contents are untouched, so no rebinning error is introduced).
+ */
+inline void shift_tof_axis(TH2F* h_time_energy, double t0_offset_ns)
+{
+    TAxis* axis = h_time_energy->GetXaxis();
+    std::vector<double> edges = axis_bin_edges(axis);
+    for (double& e : edges)
+        e -= t0_offset_ns;
+    axis->Set(axis->GetNbins(), edges.data());
+}
+
+// ------------------------------------------------------------
+// TH1F output
+// ------------------------------------------------------------
+
+/**
+ * Fill a net-yield-vs-TOF histogram with the TOF bin edges of
+ * h_time_energy (variable edges, e.g. after shift_tof_axis, are
+ * kept). The histogram is detached from any TFile.
+ */
+inline std::unique_ptr<TH1F> make_yield_histogram(
+    const std::string& name,
+    const TH2F* h_time_energy,
+    const YieldResult& yield
+)
+{
+    const int nTOF = h_time_energy->GetNbinsX();
+    const std::vector<double> edges =
+        axis_bin_edges(h_time_energy->GetXaxis());
+    auto h_yield_tof = std::make_unique<TH1F>(
+        name.c_str(),
+        "Net #gamma yield vs TOF;TOF [ns];Counts",
+        nTOF, edges.data()
+    );
+    h_yield_tof->SetDirectory(nullptr);
+
+    for (int i = 0; i < nTOF; ++i) {
+        h_yield_tof->SetBinContent(i + 1, yield.yield[i]);
+        h_yield_tof->SetBinError(i + 1, yield.error[i]);
+    }
+
+    return h_yield_tof;
+}
+
+/**
+ * Fill a net-yield histogram with variable bin edges.
+ * The histogram is detached from any TFile.
+ */
+inline std::unique_ptr<TH1F> make_binned_yield_histogram(
+    const std::string& name,
+    const std::string& title,
+    const std::vector<double>& edges,
+    const YieldResult& yield
+)
+{
+    const int n = static_cast<int>(edges.size()) - 1;
+    auto h = std::make_unique<TH1F>(name.c_str(), title.c_str(),
+                                    n, edges.data());
+    h->SetDirectory(nullptr);
+
+    for (int i = 0; i < n; ++i) {
+        h->SetBinContent(i + 1, yield.yield[i]);
+        h->SetBinError(i + 1, yield.error[i]);
+    }
+
+    return h;
+}
+
+/**
+ * Net yield vs neutron energy, energy edges in MeV.
+ */
+inline std::unique_ptr<TH1F> make_energy_yield_histogram(
+    const std::string& name,
+    const std::vector<double>& energy_edges,
+    const YieldResult& yield
+)
+{
+    return make_binned_yield_histogram(
+        name,
+        "Net #gamma yield vs neutron energy;E_{n} [MeV];Counts",
+        energy_edges, yield);
+}
+
+/**
+ * Net yield vs TOF after adaptive rebinning of h_time_energy's
+ * TOF axis.
+ */
+inline std::unique_ptr<TH1F> make_adaptive_yield_histogram(
+    const std::string& name,
+    const TH2F* h_time_energy,
+    const AdaptiveBinning& binning
+)
+{
+    const std::vector<double> tof_edges =
+        axis_bin_edges(h_time_energy->GetXaxis());
+
+    std::vector<double> edges;
+    for (int first : binning.first_bin)
+        edges.push_back(tof_edges[first]);
+
+    return make_binned_yield_histogram(
+        name,
+        "Net #gamma yield vs TOF (adaptive binning);TOF [ns];Counts",
+        edges, binning.yield);
+}
+
+// ------------------------------------------------------------
+// Online monitoring
+// ------------------------------------------------------------
+
+/**
+ * Start an incremental extraction with the binning of
+ * h_time_energy, seeded with its current content. Returns false
+ * if the windows overlap (see IncrementalYield::reset).
+ */
+inline bool start_incremental_yield(
+    IncrementalYield& inc,
+    const TH2F* h_time_energy,
+    const YieldWindows& w
+)
+{
+    const int nTOF = h_time_energy->GetNbinsX();
+    const int nE   = h_time_energy->GetNbinsY();
+    if (!inc.reset(nTOF, nE, w))
+        return false;
+
+    const WindowSumTable table = build_window_sum_table(h_time_energy);
+    for (int ib = 1; ib <= nTOF; ++ib)
+        inc.set_sums(ib,
+                     table.integral(ib, w.peak_min, w.peak_max),
+                     table.integral(ib, w.bkgL_min, w.bkgL_max),
+                     table.integral(ib, w.bkgR_min, w.bkgR_max));
+    return true;
+}
+
+/**
+ * Add one event (TOF in ns, energy in axis units) using the axes of
+ * h_time_energy for the bin lookup.
+ */
+inline void add_event(
+    IncrementalYield& inc,
+    const TH2F* h_time_energy,
+    double tof_ns, double energy,
+    double weight = 1.0
+)
+{
+    inc.add(h_time_energy->GetXaxis()->FindFixBin(tof_ns),
+            h_time_energy->GetYaxis()->FindFixBin(energy),
+            weight);
+}
+
+/**
+ * Push the changed TOF bins into h_yield_tof (same TOF binning).
+ * Returns the number of bins updated.
+ */
+inline size_t refresh_yield_histogram(IncrementalYield& inc, TH1F* h_yield_tof)
+{
+    return inc.refresh([h_yield_tof](int ib, double net, double err) {
+        h_yield_tof->SetBinContent(ib, net);
+        h_yield_tof->SetBinError(ib, err);
+    });
+}
+
+/**
+ * Normalized yield vs run time (slice edges in the units of the
+ * time branch), and the probability that the slices are consistent
+ * with a constant yield.
+ */
+inline std::unique_ptr<TH1F> make_stability_histogram(
+    const std::string& name,
+    const std::vector<double>& time_edges,
+    const StabilityResult& stability,
+    double* p_value = nullptr
+)
+{
+    if (p_value)
+        *p_value = stability.ndf > 0
+                 ? TMath::Prob(stability.chi2, stability.ndf) : 1.0;
+
+    return make_binned_yield_histogram(
+        name,
+        "Normalized #gamma yield vs run time;time;Yield / normalization",
+        time_edges, stability.normalized);
+}
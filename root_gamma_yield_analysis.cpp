@@ -11,112 +11,24 @@
  *  The code is intentionally simplified and uses non-sensitive inputs.
  *
  *  Author: Ali F. Alwars
+ *
+ *  Compile:
+ *    g++ -std=c++17 -O2 -pthread root_gamma_yield_analysis.cpp \
+ *        $(root-config --cflags --libs) -o gamma_yield
  */
 
 #include <iostream>
-#include <vector>
-#include <cmath>
-#include <algorithm>
+#include <memory>
 
+#include "TROOT.h"
 #include "TFile.h"
 #include "TH1F.h"
 #include "TH2F.h"
-#include "TAxis.h"
-#include "TMath.h"
-
-// ------------------------------------------------------------
-// Physical constants
-// ------------------------------------------------------------
-namespace constants {
-    constexpr double c_light      = 0.299792458;   // m/ns
-    constexpr double neutron_mass = 1.674927471e-27; // kg
-    constexpr double joule_to_MeV = 1.0 / 1.602176634e-13;
-    constexpr double flight_path  = 99.6755;        // m
-}
-
-// ------------------------------------------------------------
-// Utility functions
-// ------------------------------------------------------------
-
-/**
- * Convert neutron TOF (ns) to kinetic energy (MeV)
- * using relativistic kinematics.
- */
-double tof_ns_to_energy_MeV(double tof_ns)
-{
-    const double time_s = tof_ns * 1e-9;
-    const double velocity = constants::flight_path / time_s;
-    const double beta = velocity / 299792458.0;
-
-    const double gamma =
-        1.0 / std::sqrt(1.0 - beta * beta);
-
-    const double energy_J =
-        constants::neutron_mass *
-        std::pow(299792458.0, 2) * (gamma - 1.0);
-
-    return energy_J * constants::joule_to_MeV;
-}
-
-// ------------------------------------------------------------
-// Yield extraction
-// ------------------------------------------------------------
-
-struct YieldResult {
-    std::vector<double> yield;
-    std::vector<double> error;
-};
-
-/**
- * Extract net gamma-ray yield per TOF bin using
- * left/right side-band background subtraction.
- */
-YieldResult extract_yield(
-    const TH2F* h_time_energy,
-    int peak_min, int peak_max,
-    int bkgL_min, int bkgL_max,
-    int bkgR_min, int bkgR_max
-)
-{
-    const int nTOF = h_time_energy->GetNbinsX();
-
-    YieldResult result;
-    result.yield.resize(nTOF, 0.0);
-    result.error.resize(nTOF, 0.0);
-
-    const double peak_width = peak_max - peak_min;
-    const double bkgL_width = bkgL_max - bkgL_min;
-    const double bkgR_width = bkgR_max - bkgR_min;
-
-    for (int ib = 1; ib <= nTOF; ++ib) {
-
-        const double gross =
-            h_time_energy->Integral(ib, ib, peak_min, peak_max);
-
-        const double bkgL =
-            h_time_energy->Integral(ib, ib, bkgL_min, bkgL_max);
+#include "TH3F.h"
 
-        const double bkgR =
-            h_time_energy->Integral(ib, ib, bkgR_min, bkgR_max);
-
-        const double net =
-            gross
-            - 0.5 * (peak_width / bkgL_width) * bkgL
-            - 0.5 * (peak_width / bkgR_width) * bkgR;
-
-        const double err =
-            std::sqrt(
-                gross +
-                std::pow(0.5 * peak_width / bkgL_width, 2) * bkgL +
-                std::pow(0.5 * peak_width / bkgR_width, 2) * bkgR
-            );
-
-        result.yield[ib - 1] = net;
-        result.error[ib - 1] = err;
-    }
-
-    return result;
-}
+#include "root_gamma_yield.h"
+#include "root_gamma_yield_events.h"
+#include "root_gamma_yield_histogram.h"
 
 // ------------------------------------------------------------
 // Main analysis example
@@ -134,6 +46,18 @@ int main()
     TH2F* h_time_energy =
         dynamic_cast<TH2F*>(input.Get("h_time_energy"));
 
+    // Alternative input: event-level tree, binned on the fly
+    std::unique_ptr<TH2F> h_from_events;
+    if (!h_time_energy && input.Get("events")) {
+        ROOT::EnableImplicitMT();       // multi-threaded event loop
+        EventMatrixConfig matrix_cfg;   // example binning/calibration
+        h_from_events = std::move(
+            build_time_energy_matrices(
+                "events", {"example_time_energy.root"}, matrix_cfg
+            ).front());
+        h_time_energy = h_from_events.get();
+    }
+
     if (!h_time_energy) {
         std::cerr << "Histogram not found\n";
         return 1;
@@ -156,23 +80,54 @@ int main()
         );
 
     // Create TOF histogram
-    const int nTOF = h_time_energy->GetNbinsX();
-    TH1F h_yield_tof(
-        "h_yield_tof",
-        "Net #gamma yield vs TOF;TOF [ns];Counts",
-        nTOF,
-        h_time_energy->GetXaxis()->GetXmin(),
-        h_time_energy->GetXaxis()->GetXmax()
-    );
-
-    for (int i = 0; i < nTOF; ++i) {
-        h_yield_tof.SetBinContent(i + 1, yield.yield[i]);
-        h_yield_tof.SetBinError(i + 1, yield.error[i]);
+    auto h_yield_tof =
+        make_yield_histogram("h_yield_tof", h_time_energy, yield);
+
+    // Neutron-energy binning (example values): equal lethargy,
+    // 20 bins per decade between 0.5 and 200 MeV
+    const TofEnergyBinMap energy_map =
+        build_tof_energy_map(
+            axis_bin_edges(h_time_energy->GetXaxis()),
+            equal_lethargy_edges(0.5, 200.0, 20)
+        );
+
+    auto h_yield_energy =
+        make_energy_yield_histogram(
+            "h_yield_energy",
+            energy_map.energy_edges,
+            rebin_yield_to_energy(yield, energy_map)
+        );
+
+    // Adaptive TOF binning: merge bins up to 10 % relative error
+    auto h_yield_tof_adaptive =
+        make_adaptive_yield_histogram(
+            "h_yield_tof_adaptive",
+            h_time_energy,
+            adaptive_rebin(yield, 0.10)
+        );
+
+    // All detectors at once, if the input also has the stacked
+    // (TOF, energy, detector) matrix; same windows for every detector
+    std::vector<std::unique_ptr<TH1F>> h_yield_tof_det;
+    if (auto* h_time_energy_det =
+            dynamic_cast<TH3F*>(input.Get("h_time_energy_det"))) {
+        const DetectorYields det_yields =
+            extract_detector_yields(
+                to_histogram3d(h_time_energy_det),
+                {{"", peak_min, peak_max,
+                  bkgL_min, bkgL_max, bkgR_min, bkgR_max}}
+            );
+        h_yield_tof_det =
+            make_detector_yield_histograms(h_time_energy_det, det_yields);
     }
 
     // Write output
     TFile output("gamma_yield_output.root", "RECREATE");
-    h_yield_tof.Write();
+    h_yield_tof->Write();
+    h_yield_energy->Write();
+    h_yield_tof_adaptive->Write();
+    for (const auto& h : h_yield_tof_det)
+        h->Write();
     output.Close();
 
     std::cout << "Yield extraction finished successfully.\n";
@@ -0,0 +1,87 @@
+/**
+ *  root_gamma_yield_angular.h
+ *
+ *  Angle integration (gamma_angular_distribution.h) of
+ *  per-detector differential yield histograms.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1F.h"
+#include "TAxis.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_angular_distribution.h"
+
+// ------------------------------------------------------------
+// TH1F input and output
+// ------------------------------------------------------------
+
+/**
+ * Angle-integrated yield from the differential yield histograms of
+ * detectors at angle_deg (all with the binning of the first one),
+ * named h_yield_integrated. Returns nullptr if the fit rejects the
+ * configuration or inputs (see fit_angular_distribution).
+ */
+inline std::unique_ptr<TH1F> angle_integrated_histogram(
+    const std::vector<const TH1F*>& h_detectors,
+    const std::vector<double>& angle_deg,
+    const AngularFitConfig& cfg = AngularFitConfig{},
+    AngularFitResult* details = nullptr
+)
+{
+    if (h_detectors.empty())
+        return nullptr;
+
+    std::vector<YieldResult> yields;
+    for (const TH1F* h : h_detectors)
+        yields.push_back(histogram_to_yield(h));
+
+    AngularFitResult result = fit_angular_distribution(yields, angle_deg, cfg);
+    if (!result.valid)
+        return nullptr;
+
+    auto h_integrated = make_binned_yield_histogram(
+        "h_yield_integrated",
+        "Angle-integrated #gamma yield;TOF [ns];Yield",
+        axis_bin_edges(h_detectors.front()->GetXaxis()),
+        result.integrated);
+
+    if (details)
+        *details = std::move(result);
+    return h_integrated;
+}
+
+/**
+ * One histogram per fitted Legendre coefficient, h_legendre_a<l>,
+ * with errors from the diagonal of the per-bin covariance.
+ */
+inline std::vector<std::unique_ptr<TH1F>> make_legendre_histograms(
+    const std::vector<double>& edges,
+    const AngularFitResult& result
+)
+{
+    std::vector<std::unique_ptr<TH1F>> out;
+    const int np = result.n_par();
+    for (int p = 0; p < np; ++p) {
+        YieldResult a;
+        a.yield = result.coefficient[p];
+        a.error = result.covariance[p * np + p];
+        for (double& e : a.error)
+            e = std::sqrt(e);
+
+        const std::string l = std::to_string(result.orders[p]);
+        out.push_back(make_binned_yield_histogram(
+            "h_legendre_a" + l,
+            "Legendre coefficient a_{" + l + "};TOF [ns];a_{" + l + "}",
+            edges, a));
+    }
+    return out;
+}
@@ -0,0 +1,246 @@
+/**
+ *  root_gamma_yield_batch.cpp
+ *
+ *  Batch driver for the side-band yield extraction of
+ *  root_gamma_yield_analysis.cpp. Processes many run files and
+ *  detector histograms in one process, so ROOT start-up is paid
+ *  once, and writes all net-yield histograms into one output file.
+ *
+ *  Each input file is opened once, on a worker thread, and all
+ *  histograms requested from it are extracted there. The worker
+ *  then writes its histograms through a TBufferMerger
+ *  (root_gamma_yield_output.h), so output is serialized in parallel
+ *  and no histogram is kept after it was written.
+ *
+ *  Author: Ali F. Alwars
+ *
+ *  Compile:
+ *    g++ -std=c++17 -O2 -pthread root_gamma_yield_batch.cpp \
+ *        $(root-config --cflags --libs) -o gamma_yield_batch
+ *
+ *  Usage:
+ *    ./gamma_yield_batch jobs.txt [output.root] [n_threads] [cache_dir]
+ *  With cache_dir, results are kept in a content-addressed cache
+ *  (gamma_yield_cache.h, 1 GiB limit), so histograms that did not
+ *  change since an earlier run are not extracted again.
+ *
+ *  Job file, one extraction per line ('#' starts a comment):
+ *    file.root  histogram  peak_min peak_max  bkgL_min bkgL_max  bkgR_min bkgR_max  [label]
+ *  The output histogram is named h_yield_tof_<label>; the default
+ *  label is <file stem>_<histogram>. Labels must be unique (the
+ *  parallel output adds histograms of the same name), so jobs on
+ *  equally named files in different directories, or several window
+ *  sets on one histogram, need explicit labels.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TH1F.h"
+#include "TH2F.h"
+
+#include "root_gamma_yield.h"
+#include "root_gamma_yield_cache.h"
+#include "root_gamma_yield_output.h"
+
+// ------------------------------------------------------------
+// Job description
+// ------------------------------------------------------------
+
+struct BatchJob {
+    std::string file;
+    std::string histogram;
+    YieldWindows windows;     // windows.name holds the output label
+};
+
+struct BatchOutput {
+    bool written = false;
+    std::string error;
+};
+
+static std::string file_stem(const std::string& path)
+{
+    const size_t slash = path.find_last_of('/');
+    std::string stem = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    const size_t dot = stem.rfind(".root");
+    return stem.substr(0, dot);
+}
+
+static bool read_job_file(const std::string& path, std::vector<BatchJob>& jobs)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: cannot open " << path << "\n";
+        return false;
+    }
+
+    std::map<std::string, int> label_line;   // label -> first job line
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream ss(line);
+        BatchJob job;
+        YieldWindows& w = job.windows;
+
+        if (!(ss >> job.file))
+            continue;   // blank or comment line
+
+        if (!(ss >> job.histogram
+                 >> w.peak_min >> w.peak_max
+                 >> w.bkgL_min >> w.bkgL_max
+                 >> w.bkgR_min >> w.bkgR_max)) {
+            std::cerr << "Error: malformed job at " << path
+                      << ":" << line_no << "\n";
+            return false;
+        }
+
+        if (!(ss >> w.name))
+            w.name = file_stem(job.file) + "_" + job.histogram;
+
+        const auto seen = label_line.emplace(w.name, line_no);
+        if (!seen.second) {
+            std::cerr << "Error: label " << w.name << " at " << path
+                      << ":" << line_no << " already used at line "
+                      << seen.first->second << "; give an explicit label\n";
+            return false;
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+// ------------------------------------------------------------
+// Processing
+// ------------------------------------------------------------
+
+/**
+ * Open one input file, extract every job that refers to it and
+ * write the results. Runs on a worker thread; touches only its own
+ * TFile and outputs.
+ */
+static void process_file(const std::string& file,
+                         const std::vector<size_t>& job_ids,
+                         const std::vector<BatchJob>& jobs,
+                         std::vector<BatchOutput>& outputs,
+                         ParallelYieldOutput& output,
+                         YieldCache* cache)
+{
+    std::unique_ptr<TFile> input(TFile::Open(file.c_str(), "READ"));
+    if (!input || input->IsZombie()) {
+        for (size_t id : job_ids)
+            outputs[id].error = "cannot open " + file;
+        return;
+    }
+
+    std::vector<std::unique_ptr<TH1F>> histograms;
+    std::vector<size_t> written_ids;
+
+    for (size_t id : job_ids) {
+        const BatchJob& job = jobs[id];
+
+        TH2F* h_time_energy =
+            dynamic_cast<TH2F*>(input->Get(job.histogram.c_str()));
+        if (!h_time_energy) {
+            outputs[id].error = "histogram " + job.histogram
+                              + " not found in " + file;
+            continue;
+        }
+
+        const YieldWindows& w = job.windows;
+        const YieldResult yield = cache
+            ? extract_yields_cached(*cache, h_time_energy, {w}, 1).front()
+            : extract_yield(
+                  h_time_energy,
+                  w.peak_min, w.peak_max,
+                  w.bkgL_min, w.bkgL_max,
+                  w.bkgR_min, w.bkgR_max
+              );
+
+        histograms.push_back(
+            make_yield_histogram("h_yield_tof_" + w.name,
+                                 h_time_energy, yield));
+        written_ids.push_back(id);
+    }
+
+    input->Close();
+
+    output.write(histograms);
+    for (size_t id : written_ids)
+        outputs[id].written = true;
+}
+
+// ------------------------------------------------------------
+// Main
+// ------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " jobs.txt [output.root] [n_threads] [cache_dir]\n";
+        return 1;
+    }
+
+    const std::string output_name =
+        argc > 2 ? argv[2] : "gamma_yield_batch_output.root";
+    const unsigned n_threads =
+        argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 0;
+
+    std::unique_ptr<YieldCache> cache;
+    if (argc > 4) {
+        YieldCacheConfig cache_cfg;
+        cache_cfg.directory = argv[4];
+        cache = std::make_unique<YieldCache>(cache_cfg);
+    }
+
+    std::vector<BatchJob> jobs;
+    if (!read_job_file(argv[1], jobs))
+        return 1;
+
+    // Group jobs by input file so that every file is opened once
+    std::map<std::string, std::vector<size_t>> jobs_by_file;
+    for (size_t i = 0; i < jobs.size(); ++i)
+        jobs_by_file[jobs[i].file].push_back(i);
+
+    std::vector<const std::pair<const std::string,
+                                std::vector<size_t>>*> files;
+    for (const auto& kv : jobs_by_file)
+        files.push_back(&kv);
+
+    std::cout << "Processing " << jobs.size() << " extractions from "
+              << files.size() << " files\n";
+
+    ROOT::EnableThreadSafety();
+
+    std::vector<BatchOutput> outputs(jobs.size());
+    {
+        ParallelYieldOutput output(output_name);
+        parallel_for(files.size(), [&](size_t i) {
+            process_file(files[i]->first, files[i]->second, jobs, outputs,
+                         output, cache.get());
+        }, n_threads);
+    }   // output file closed here
+
+    int failed = 0;
+    for (const auto& out : outputs)
+        if (!out.written) {
+            std::cerr << "Error: " << out.error << "\n";
+            ++failed;
+        }
+
+    std::cout << "Wrote " << jobs.size() - failed << " yield histograms to "
+              << output_name << "\n";
+    return failed == 0 ? 0 : 1;
+}
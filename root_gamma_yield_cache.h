@@ -0,0 +1,57 @@
+/**
+ *  root_gamma_yield_cache.h
+ *
+ *  Cached extraction from TH2F histograms through the result
+ *  cache of gamma_yield_cache.h.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "TH2F.h"
+#include "TAxis.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_yield_cache.h"
+
+// ------------------------------------------------------------
+// Cached extraction
+// ------------------------------------------------------------
+
+/**
+ * Hash of a TH2F for the result cache: bin edges of both axes and
+ * the raw contents including under/overflow.
+ */
+inline ContentHash hash_histogram(const TH2F* h_time_energy)
+{
+    ContentHash hash;
+    for (const TAxis* axis : {h_time_energy->GetXaxis(),
+                              h_time_energy->GetYaxis()}) {
+        const std::vector<double> edges = axis_bin_edges(axis);
+        hash.update_value(edges.size());
+        hash.update(edges.data(), edges.size() * sizeof(double));
+    }
+    const size_t n_cells = size_t(h_time_energy->GetNbinsX() + 2)
+                         * (h_time_energy->GetNbinsY() + 2);
+    hash.update(h_time_energy->GetArray(), n_cells * sizeof(float));
+    return hash;
+}
+
+/**
+ * extract_yields() through the result cache: unchanged histogram
+ * contents and windows are answered from disk.
+ */
+inline std::vector<YieldResult> extract_yields_cached(
+    YieldCache& cache,
+    const TH2F* h_time_energy,
+    const std::vector<YieldWindows>& lines,
+    unsigned n_threads = 0
+)
+{
+    return cached_yields(
+        cache, yield_cache_key(hash_histogram(h_time_energy), lines),
+        [&]() { return extract_yields(h_time_energy, lines, n_threads); });
+}
@@ -0,0 +1,153 @@
+/**
+ *  root_gamma_yield_calibration.h
+ *
+ *  ROOT adapters of detector gain matching (gamma_gain_match.h)
+ *  and automatic energy calibration (gamma_peak_search.h).
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH2F.h"
+#include "TAxis.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_gain_match.h"
+#include "gamma_peak_search.h"
+
+// ------------------------------------------------------------
+// Gain matching and calibration
+// ------------------------------------------------------------
+
+/**
+ * Gain-match every detector's matrix onto a common energy axis
+ * (n_energy bins in [e_min, e_max]) with its calibration and sum
+ * them. calibrations[d] belongs to detectors[d], and all detectors
+ * must share the TOF bin edges of the first one; returns nullptr
+ * otherwise.
+ *
+ * Only bin contents are filled, so ROOT reports sqrt(content) as
+ * the error. Gain matching splits source bins between target bins
+ * by overlap fraction f, whose true variance is f^2 n rather than
+ * f n, and makes neighbouring bins correlated: the errors are
+ * approximate, conservative per bin.
+ */
+inline std::unique_ptr<TH2F> gain_match_and_sum(
+    const std::vector<const TH2F*>& detectors,
+    const std::vector<EnergyCalibration>& calibrations,
+    int n_energy, double e_min, double e_max,
+    unsigned n_threads = 0
+)
+{
+    if (detectors.empty() || calibrations.size() != detectors.size())
+        return nullptr;
+
+    const TH2F* ref = detectors.front();
+    const int nTOF = ref->GetNbinsX();
+    const std::vector<double> tof_edges = axis_bin_edges(ref->GetXaxis());
+    for (const TH2F* h : detectors) {
+        const std::vector<double> edges = axis_bin_edges(h->GetXaxis());
+        if (edges.size() != tof_edges.size())
+            return nullptr;
+        for (size_t i = 0; i < edges.size(); ++i)
+            if (std::abs(edges[i] - tof_edges[i]) >
+                1e-9 * (std::abs(tof_edges[i]) + 1.0))
+                return nullptr;
+    }
+
+    std::vector<double> target_edges(n_energy + 1);
+    for (int i = 0; i <= n_energy; ++i)
+        target_edges[i] = e_min + (e_max - e_min) * i / n_energy;
+
+    const size_t n_det = detectors.size();
+    std::vector<std::vector<double>> rows(n_det);
+    std::vector<OverlapMap> maps(n_det);
+    std::vector<const double*> sources(n_det);
+    std::vector<int> n_src_bins(n_det);
+
+    parallel_for(n_det, [&](size_t d) {
+        rows[d] = matrix_rows(detectors[d]);
+        maps[d] = build_overlap_map(axis_bin_edges(detectors[d]->GetYaxis()),
+                                    calibrations[d], target_edges);
+    }, n_threads);
+
+    for (size_t d = 0; d < n_det; ++d) {
+        sources[d]    = rows[d].data();
+        n_src_bins[d] = detectors[d]->GetNbinsY();
+    }
+
+    const std::vector<double> sum =
+        gain_match_and_sum(sources, n_src_bins, maps, nTOF, n_threads);
+
+    auto h_sum = std::make_unique<TH2F>(
+        "h_time_energy_sum",
+        "Gain-matched sum;TOF [ns];E_{#gamma} [keV]",
+        nTOF, tof_edges.data(),
+        n_energy, e_min, e_max
+    );
+    h_sum->SetDirectory(nullptr);
+
+    for (int ib = 1; ib <= nTOF; ++ib)
+        for (int ie = 1; ie <= n_energy; ++ie)
+            h_sum->SetBinContent(ib, ie,
+                                 sum[size_t(ib - 1) * n_energy + (ie - 1)]);
+
+    return h_sum;
+}
+
+/**
+ * Energy spectrum of h_time_energy summed over all TOF bins
+ * (element 0 = energy bin 1).
+ */
+inline std::vector<double> energy_projection(const TH2F* h_time_energy)
+{
+    const int nTOF = h_time_energy->GetNbinsX();
+    const int nE   = h_time_energy->GetNbinsY();
+
+    std::vector<double> spectrum(nE, 0.0);
+    for (int ie = 1; ie <= nE; ++ie)
+        for (int ib = 1; ib <= nTOF; ++ib)
+            spectrum[ie - 1] += h_time_energy->GetBinContent(ib, ie);
+    return spectrum;
+}
+
+/**
+ * Nominal calibration of a uniform energy axis in bin coordinates
+ * (centre of bin i at x = i).
+ */
+inline EnergyCalibration axis_calibration(const TAxis* axis)
+{
+    const double width = (axis->GetXmax() - axis->GetXmin()) / axis->GetNbins();
+    return EnergyCalibration{axis->GetXmin() - 0.5 * width, width, 0.0};
+}
+
+/**
+ * Peak search and energy recalibration of many runs in parallel.
+ * The nominal energy axis of each matrix is the starting guess;
+ * fwhm_keV sets the filter width.
+ */
+inline std::vector<CalibrationFit> calibrate_runs(
+    const std::vector<const TH2F*>& runs,
+    const std::vector<double>& reference_keV,
+    double fwhm_keV,
+    double tolerance_keV,
+    int order = 1,
+    unsigned n_threads = 0
+)
+{
+    std::vector<CalibrationFit> fits(runs.size());
+    parallel_for(runs.size(), [&](size_t i) {
+        const EnergyCalibration guess = axis_calibration(runs[i]->GetYaxis());
+        const std::vector<PeakCandidate> peaks =
+            find_peaks(energy_projection(runs[i]), fwhm_keV / guess.c1);
+        fits[i] = calibrate_energy(peaks, reference_keV, guess,
+                                   tolerance_keV, order);
+    }, n_threads);
+    return fits;
+}
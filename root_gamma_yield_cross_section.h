@@ -0,0 +1,40 @@
+/**
+ *  root_gamma_yield_cross_section.h
+ *
+ *  Cross-section histograms from the normalization in
+ *  gamma_cross_section.h.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1F.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_cross_section.h"
+
+// ------------------------------------------------------------
+// TH1F output
+// ------------------------------------------------------------
+
+/**
+ * Cross section with per-bin (statistical) errors, same binning
+ * as the yields it was derived from.
+ */
+inline std::unique_ptr<TH1F> make_cross_section_histogram(
+    const std::string& name,
+    const std::string& x_title,
+    const std::vector<double>& edges,
+    const CrossSectionResult& xs
+)
+{
+    return make_binned_yield_histogram(
+        name,
+        ";" + x_title + ";#sigma_{#gamma} [b]",
+        edges, YieldResult{xs.value, xs.stat_error});
+}
@@ -0,0 +1,276 @@
+/**
+ *  root_gamma_yield_events.h
+ *
+ *  Event-level input for the yield extraction: builds the
+ *  TOF-energy matrix directly from (tof, energy, detector) trees
+ *  with RDataFrame, so TOF binning, T0 offset and energy
+ *  calibration can be changed by simply re-running.
+ *
+ *  Calibration and cuts are booked lazily; all requested detector
+ *  matrices are filled in a single event loop. The loops run on
+ *  ROOT's implicit thread pool if the program enabled it (call
+ *  ROOT::EnableImplicitMT in main, before any RDataFrame); these
+ *  functions never change the global thread configuration.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TH1D.h"
+#include "TH2F.h"
+#include "ROOT/RDataFrame.hxx"
+
+#include "root_gamma_yield.h"
+
+// ------------------------------------------------------------
+// Matrix definition
+// ------------------------------------------------------------
+
+struct EventMatrixConfig {
+    // Input branch names
+    std::string tof_branch      = "tof";        // ns
+    std::string energy_branch   = "energy";     // raw (channel) or keV
+    std::string detector_branch = "detector";
+
+    // TOF correction and energy calibration:
+    //   tof_ns     = tof - tof_offset_ns
+    //   energy_keV = cal_c0 + cal_c1 * energy + cal_c2 * energy^2
+    double tof_offset_ns = 0.0;
+    double cal_c0 = 0.0;
+    double cal_c1 = 1.0;
+    double cal_c2 = 0.0;
+
+    // Additional event selection (RDataFrame expression, may be empty)
+    std::string cut;
+
+    // Run-time branch used for time slicing (any unit)
+    std::string time_branch = "timestamp";
+
+    // Output binning
+    int    n_tof      = 1000;
+    double tof_min    = 0.0;      // ns
+    double tof_max    = 10000.0;  // ns
+    int    n_energy   = 4096;
+    double energy_min = 0.0;      // keV
+    double energy_max = 4096.0;   // keV
+};
+
+inline std::string rdf_number(double value)
+{
+    std::ostringstream ss;
+    ss.precision(17);
+    ss << "(" << value << ")";
+    return ss.str();
+}
+
+/**
+ * Calibrated TOF and energy columns, with the user cut applied.
+ */
+inline ROOT::RDF::RNode calibrated_events(
+    ROOT::RDataFrame& df,
+    const EventMatrixConfig& cfg
+)
+{
+    const std::string& e = cfg.energy_branch;
+
+    ROOT::RDF::RNode calibrated =
+        df.Define("tof_ns", cfg.tof_branch + " - " + rdf_number(cfg.tof_offset_ns))
+          .Define("energy_keV",
+                  rdf_number(cfg.cal_c0) + " + " +
+                  rdf_number(cfg.cal_c1) + " * " + e + " + " +
+                  rdf_number(cfg.cal_c2) + " * " + e + " * " + e);
+
+    if (!cfg.cut.empty())
+        calibrated = calibrated.Filter(cfg.cut, "user cut");
+
+    return calibrated;
+}
+
+inline TH2F time_energy_model(const std::string& name,
+                              const EventMatrixConfig& cfg)
+{
+    return TH2F(
+        name.c_str(),
+        "TOF vs #gamma energy;TOF [ns];E_{#gamma} [keV]",
+        cfg.n_tof, cfg.tof_min, cfg.tof_max,
+        cfg.n_energy, cfg.energy_min, cfg.energy_max
+    );
+}
+
+/**
+ * Fill one TOF-energy matrix per requested detector from event
+ * trees. detectors = {-1} fills a single matrix from all detectors.
+ * Matrices are named
+ * h_time_energy_det<id> (h_time_energy for the combined one) and
+ * are detached from any TFile.
+ */
+inline std::vector<std::unique_ptr<TH2F>> build_time_energy_matrices(
+    const std::string& tree_name,
+    const std::vector<std::string>& files,
+    const EventMatrixConfig& cfg,
+    const std::vector<int>& detectors = {-1}
+)
+{
+    ROOT::RDataFrame df(tree_name, files);
+
+    ROOT::RDF::RNode calibrated = calibrated_events(df, cfg);
+
+    // Book every matrix before touching any result: one event loop
+    std::vector<ROOT::RDF::RResultPtr<TH2F>> booked;
+    for (int det : detectors) {
+        const std::string name =
+            det < 0 ? "h_time_energy"
+                    : "h_time_energy_det" + std::to_string(det);
+
+        const TH2F model = time_energy_model(name, cfg);
+
+        ROOT::RDF::RNode selected =
+            det < 0 ? calibrated
+                    : calibrated.Filter(cfg.detector_branch + " == " +
+                                        std::to_string(det));
+
+        booked.push_back(
+            selected.Fill<double, double>(model, {"tof_ns", "energy_keV"}));
+    }
+
+    std::vector<std::unique_ptr<TH2F>> matrices;
+    for (auto& result : booked) {
+        auto h = std::make_unique<TH2F>(*result);
+        h->SetDirectory(nullptr);
+        matrices.push_back(std::move(h));
+    }
+
+    return matrices;
+}
+
+// ------------------------------------------------------------
+// Gamma-flash T0
+// ------------------------------------------------------------
+
+/**
+ * Locate the gamma flash of every run file from its event tree.
+ * One TOF histogram (n_bins in [tof_min, tof_max] ns, with the
+ * current cfg.tof_offset_ns applied) is booked per run, and all
+ * runs are processed concurrently with RunGraphs. Add the returned
+ * t0_offset_ns to cfg.tof_offset_ns (see apply_t0) to correct a run.
+ */
+inline std::vector<GammaFlash> find_gamma_flash_runs(
+    const std::string& tree_name,
+    const std::vector<std::string>& run_files,
+    const EventMatrixConfig& cfg,
+    int n_bins, double tof_min, double tof_max
+)
+{
+    std::vector<std::unique_ptr<ROOT::RDataFrame>> frames;
+    std::vector<ROOT::RDF::RResultPtr<TH1D>> booked;
+    std::vector<ROOT::RDF::RResultHandle> handles;
+
+    for (size_t i = 0; i < run_files.size(); ++i) {
+        frames.push_back(
+            std::make_unique<ROOT::RDataFrame>(tree_name, run_files[i]));
+
+        const TH1D model(("h_tof_run" + std::to_string(i)).c_str(),
+                         ";TOF [ns];Counts", n_bins, tof_min, tof_max);
+        booked.push_back(
+            calibrated_events(*frames.back(), cfg)
+                .Fill<double>(model, {"tof_ns"}));
+        handles.push_back(booked.back());
+    }
+
+    ROOT::RDF::RunGraphs(handles);
+
+    std::vector<GammaFlash> flashes;
+    for (auto& h : booked) {
+        std::vector<double> spectrum(n_bins), edges(n_bins + 1);
+        for (int i = 1; i <= n_bins; ++i)
+            spectrum[i - 1] = h->GetBinContent(i);
+        for (int i = 0; i <= n_bins; ++i)
+            edges[i] = tof_min + (tof_max - tof_min) * i / n_bins;
+        flashes.push_back(find_gamma_flash(spectrum, edges));
+    }
+
+    return flashes;
+}
+
+/**
+ * Fold a measured gamma-flash offset into the event-level TOF
+ * correction.
+ */
+inline void apply_t0(EventMatrixConfig& cfg, const GammaFlash& flash)
+{
+    if (flash.found)
+        cfg.tof_offset_ns += flash.t0_offset_ns;
+}
+
+// ------------------------------------------------------------
+// Time slices
+// ------------------------------------------------------------
+
+/**
+ * Fill one TOF-energy matrix per run-time slice [edges[i], edges[i+1])
+ * of cfg.time_branch, all in a single event loop. detector < 0 uses
+ * all detectors. Matrices are named h_time_energy_slice<i>.
+ */
+inline std::vector<std::unique_ptr<TH2F>> build_time_sliced_matrices(
+    const std::string& tree_name,
+    const std::vector<std::string>& files,
+    const EventMatrixConfig& cfg,
+    const std::vector<double>& time_edges,
+    int detector = -1
+)
+{
+    ROOT::RDataFrame df(tree_name, files);
+
+    ROOT::RDF::RNode selected = calibrated_events(df, cfg);
+    if (detector >= 0)
+        selected = selected.Filter(cfg.detector_branch + " == " +
+                                   std::to_string(detector));
+
+    std::vector<ROOT::RDF::RResultPtr<TH2F>> booked;
+    for (size_t i = 0; i + 1 < time_edges.size(); ++i) {
+        const std::string in_slice =
+            cfg.time_branch + " >= " + rdf_number(time_edges[i]) + " && " +
+            cfg.time_branch + " < "  + rdf_number(time_edges[i + 1]);
+
+        booked.push_back(
+            selected.Filter(in_slice)
+                    .Fill<double, double>(
+                        time_energy_model("h_time_energy_slice" + std::to_string(i), cfg),
+                        {"tof_ns", "energy_keV"}));
+    }
+
+    std::vector<std::unique_ptr<TH2F>> matrices;
+    for (auto& result : booked) {
+        auto h = std::make_unique<TH2F>(*result);
+        h->SetDirectory(nullptr);
+        matrices.push_back(std::move(h));
+    }
+
+    return matrices;
+}
+
+/**
+ * Side-band yields of every slice matrix, extracted in parallel.
+ */
+inline std::vector<YieldResult> extract_slice_yields(
+    const std::vector<std::unique_ptr<TH2F>>& slices,
+    const YieldWindows& w,
+    unsigned n_threads = 0
+)
+{
+    std::vector<YieldResult> yields(slices.size());
+    parallel_for(slices.size(), [&](size_t i) {
+        yields[i] = extract_yield(
+            build_window_sum_table(slices[i].get()),
+            w.peak_min, w.peak_max,
+            w.bkgL_min, w.bkgL_max,
+            w.bkgR_min, w.bkgR_max);
+    }, n_threads);
+    return yields;
+}
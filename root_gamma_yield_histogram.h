@@ -0,0 +1,109 @@
+/**
+ *  root_gamma_yield_histogram.h
+ *
+ *  Conversion of TH2F/TH3F matrices into the lightweight
+ *  containers of gamma_histogram.h, and per-detector output of the
+ *  multi-detector extraction.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "TH1F.h"
+#include "TH2F.h"
+#include "TH3F.h"
+#include "TAxis.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_histogram.h"
+
+// ------------------------------------------------------------
+// Conversion and output
+// ------------------------------------------------------------
+
+/**
+ * Copy a TH2F (including energy under/overflow) into the ROOT-free
+ * Histogram2D, e.g. to convert it once with write_histogram2d().
+ * Only the axis ranges are kept, so the axes should be uniform.
+ */
+inline Histogram2D to_histogram2d(const TH2F* h_time_energy)
+{
+    const TAxis* x = h_time_energy->GetXaxis();
+    const TAxis* y = h_time_energy->GetYaxis();
+
+    Histogram2D h;
+    h.resize(x->GetNbins(), y->GetNbins());
+    h.tof_min    = x->GetXmin();
+    h.tof_max    = x->GetXmax();
+    h.energy_min = y->GetXmin();
+    h.energy_max = y->GetXmax();
+
+    for (int ib = 1; ib <= h.n_tof; ++ib)
+        for (int ie = 0; ie <= h.n_energy + 1; ++ie)
+            h.at(ib, ie) = h_time_energy->GetBinContent(ib, ie);
+    return h;
+}
+
+/**
+ * Copy a (TOF, energy, detector) TH3F into a Histogram3D: X is TOF,
+ * Y energy (under/overflow kept), Z bin k is detector k - 1.
+ * Detectors are copied in parallel.
+ */
+inline Histogram3D to_histogram3d(const TH3F* h_time_energy_det,
+                                  unsigned n_threads = 0)
+{
+    const TAxis* x = h_time_energy_det->GetXaxis();
+    const TAxis* y = h_time_energy_det->GetYaxis();
+
+    Histogram3D h;
+    h.resize(h_time_energy_det->GetNbinsZ(), x->GetNbins(), y->GetNbins());
+    h.tof_min    = x->GetXmin();
+    h.tof_max    = x->GetXmax();
+    h.energy_min = y->GetXmin();
+    h.energy_max = y->GetXmax();
+
+    parallel_for(h.n_detectors, [&](size_t d) {
+        for (int ib = 1; ib <= h.n_tof; ++ib) {
+            double* row = h.row(static_cast<int>(d), ib);
+            for (int ie = 0; ie <= h.n_energy + 1; ++ie)
+                row[ie] = h_time_energy_det->GetBinContent(
+                    ib, ie, static_cast<int>(d) + 1);
+        }
+    }, n_threads);
+
+    return h;
+}
+
+/**
+ * One net-yield-vs-TOF histogram per detector, named
+ * h_yield_tof_det<k> after the centre of Z bin k + 1 of
+ * h_time_energy_det, followed by the combined h_yield_tof_sum.
+ */
+inline std::vector<std::unique_ptr<TH1F>> make_detector_yield_histograms(
+    const TH3F* h_time_energy_det,
+    const DetectorYields& yields
+)
+{
+    const std::vector<double> edges =
+        axis_bin_edges(h_time_energy_det->GetXaxis());
+    const std::string title = "Net #gamma yield vs TOF;TOF [ns];Counts";
+
+    std::vector<std::unique_ptr<TH1F>> out;
+    for (size_t d = 0; d < yields.detector.size(); ++d) {
+        const long id = std::lround(
+            h_time_energy_det->GetZaxis()->GetBinCenter(int(d) + 1));
+        out.push_back(make_binned_yield_histogram(
+            "h_yield_tof_det" + std::to_string(id), title,
+            edges, yields.detector[d]));
+    }
+    out.push_back(make_binned_yield_histogram(
+        "h_yield_tof_sum", title, edges, yields.combined));
+
+    return out;
+}
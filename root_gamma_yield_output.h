@@ -0,0 +1,55 @@
+/**
+ *  root_gamma_yield_output.h
+ *
+ *  Parallel writing of yield histograms into one ROOT file. Writing
+ *  every histogram through a single TFile from the main thread
+ *  serializes (and compresses) all output on one core; here each
+ *  worker streams its histograms into its own in-memory file from a
+ *  ROOT::TBufferMerger, so serialization and compression run on the
+ *  workers and only the append to the output file is serialized.
+ *
+ *  Requires ROOT >= 6.26 (ROOT::TBufferMerger; older releases have
+ *  it as ROOT::Experimental::TBufferMerger) and
+ *  ROOT::EnableThreadSafety().
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1F.h"
+#include "ROOT/TBufferMerger.hxx"
+
+// ------------------------------------------------------------
+// Parallel output file
+// ------------------------------------------------------------
+
+struct ParallelYieldOutput {
+    ROOT::TBufferMerger merger;
+
+    explicit ParallelYieldOutput(const std::string& path)
+        : merger(path.c_str(), "RECREATE")
+    {
+    }
+
+    /**
+     * Write a group of histograms (e.g. all outputs of one input
+     * file) from any thread. They are serialized into a fresh
+     * in-memory file, which is then merged into the output; null
+     * entries are skipped. The histograms stay owned by the caller.
+     * Histograms of the same name from different calls are added
+     * (hadd semantics), so names should be unique.
+     */
+    void write(const std::vector<std::unique_ptr<TH1F>>& histograms)
+    {
+        auto file = merger.GetFile();
+        for (const auto& h : histograms)
+            if (h)
+                file->WriteTObject(h.get());
+        file->Write();
+    }
+};
@@ -0,0 +1,40 @@
+/**
+ *  root_gamma_yield_tiled.h
+ *
+ *  Filling of out-of-core tiled matrices (gamma_tiled_matrix.h)
+ *  from TH2F histograms. POSIX only, like the tiled matrix itself.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include "TH2F.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_tiled_matrix.h"
+
+// ------------------------------------------------------------
+// TH2F input
+// ------------------------------------------------------------
+
+/**
+ * Add the contents of h_time_energy (including energy under/overflow)
+ * to a tiled matrix with the same binning, e.g. to sum runs in
+ * uint64 without float saturation. Returns false on a binning
+ * mismatch.
+ */
+inline bool add_to_tiled_matrix(TiledMatrix& matrix, const TH2F* h_time_energy)
+{
+    if (h_time_energy->GetNbinsX() != matrix.n_tof() ||
+        h_time_energy->GetNbinsY() != matrix.n_energy())
+        return false;
+
+    for (int ib = 1; ib <= matrix.n_tof(); ++ib)
+        for (int ie = 0; ie <= matrix.n_energy() + 1; ++ie) {
+            const double c = h_time_energy->GetBinContent(ib, ie);
+            if (c != 0.0)
+                matrix.add(ib, ie, c);
+        }
+    return true;
+}
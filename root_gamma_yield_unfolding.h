@@ -0,0 +1,48 @@
+/**
+ *  root_gamma_yield_unfolding.h
+ *
+ *  TOF-resolution unfolding (gamma_unfolding.h) of net-yield
+ *  histograms.
+ *
+ *  Author: Ali F. Alwars
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TH1F.h"
+#include "TAxis.h"
+
+#include "root_gamma_yield.h"
+#include "gamma_unfolding.h"
+
+// ------------------------------------------------------------
+// TH1F input and output
+// ------------------------------------------------------------
+
+/**
+ * Unfold the TOF resolution from a net-yield histogram; the
+ * response is built from its own TOF binning.
+ */
+inline std::unique_ptr<TH1F> unfold_yield_histogram(
+    const TH1F* h_yield_tof,
+    const TofResolution& resolution,
+    const UnfoldingConfig& cfg,
+    UnfoldingResult* details = nullptr
+)
+{
+    const std::vector<double> edges = axis_bin_edges(h_yield_tof->GetXaxis());
+    const UnfoldingResult result =
+        unfold_yield(histogram_to_yield(h_yield_tof),
+                     build_tof_response(edges, resolution), cfg);
+    if (details)
+        *details = result;
+
+    return make_binned_yield_histogram(
+        std::string(h_yield_tof->GetName()) + "_unfolded",
+        "Unfolded net #gamma yield vs TOF;TOF [ns];Counts",
+        edges, result.unfolded);
+}